@@ -49,7 +49,7 @@ public class LXRFree : ModuleRules
 		PublicDependencyModuleNames.AddRange(
 			new string[]
 			{
-				"Core", "Engine", "CoreUObject"
+				"Core", "Engine", "CoreUObject", "DeveloperSettings"
 				// ... add other public dependencies that you statically link with here ...
 			}
 		);
@@ -0,0 +1,116 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRBulkPayload.h"
+#include "LXRCustomVersion.h"
+#include "Async/Async.h"
+
+FLXRBulkPayload::FLXRBulkPayload()
+{
+	BulkData.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload);
+}
+
+FLXRBulkPayload::~FLXRBulkPayload()
+{
+	Cancel();
+}
+
+void FLXRBulkPayload::Store(const TArray<uint8>& Bytes)
+{
+	Cancel();
+	BulkData.Lock(LOCK_READ_WRITE);
+	void* Data = BulkData.Realloc(Bytes.Num());
+	FMemory::Memcpy(Data, Bytes.GetData(), Bytes.Num());
+	BulkData.Unlock();
+}
+
+void FLXRBulkPayload::Serialize(FArchive& Ar, UObject* Owner)
+{
+	Ar.UsingCustomVersion(FLXRCustomVersion::GUID);
+	//Owners saved before payloads were added have no bulk data block after their properties.
+	if (Ar.IsLoading() && Ar.CustomVer(FLXRCustomVersion::GUID) < FLXRCustomVersion::AddedBulkPayload)
+		return;
+
+	BulkData.Serialize(Ar, Owner);
+}
+
+void FLXRBulkPayload::LoadAsync(TFunction<void(TArray<uint8>&&)>&& OnLoaded)
+{
+	Cancel();
+
+	if (IsEmpty() || BulkData.IsBulkDataLoaded() || !BulkData.CanLoadFromDisk())
+	{
+		TArray<uint8> Bytes;
+		if (!IsEmpty())
+		{
+			Bytes.SetNumUninitialized(BulkData.GetBulkDataSize());
+			FMemory::Memcpy(Bytes.GetData(), BulkData.LockReadOnly(), Bytes.Num());
+			BulkData.Unlock();
+		}
+		OnLoaded(MoveTemp(Bytes));
+		return;
+	}
+
+	LoadState = MakeShared<FLoadState, ESPMode::ThreadSafe>();
+	LoadState->OnLoaded = MoveTemp(OnLoaded);
+
+	//Completes on an IO thread, result is handed to game thread where owner can be touched.
+	FBulkDataIORequestCallBack Callback = [State = LoadState](bool bWasCancelled, IBulkDataIORequest* CompletedRequest)
+	{
+		TArray<uint8> Bytes;
+		if (!bWasCancelled)
+		{
+			if (uint8* Data = CompletedRequest->GetReadResults())
+			{
+				Bytes.Append(Data, CompletedRequest->GetSize());
+				FMemory::Free(Data);
+			}
+		}
+
+		AsyncTask(ENamedThreads::GameThread, [State, Bytes = MoveTemp(Bytes)]() mutable
+		{
+			if (!State->bCancelled)
+				State->OnLoaded(MoveTemp(Bytes));
+		});
+	};
+	Request = BulkData.CreateStreamingRequest(AIOP_BelowNormal, &Callback, NULL);
+}
+
+void FLXRBulkPayload::Cancel()
+{
+	if (LoadState)
+	{
+		LoadState->bCancelled = true;
+		LoadState.Reset();
+	}
+
+	if (Request)
+	{
+		Request->Cancel();
+		Request->WaitCompletion();
+		delete Request;
+		Request = NULL;
+	}
+}
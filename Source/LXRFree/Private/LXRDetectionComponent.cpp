@@ -38,6 +38,13 @@ SOFTWARE.
 #include "DrawDebugHelpers.h"
 #include "LXRFunctionLibrary.h"
 
+//Passed components of lights that did not pass, iterators of them are empty.
+static const FLXRComponentBitArray NoPassedComponents;
+
+//Async traces are answered at the end of the frame they were issued in. Traces still pending after this many frames
+//were dropped, by world teardown or level unload, and their pipeline is discarded.
+static const uint64 MaxPipelineTraceFrames = 4;
+
 // Sets default values for this component's properties
 ULXRDetectionComponent::ULXRDetectionComponent()
 {
@@ -70,21 +77,43 @@ void ULXRDetectionComponent::BeginPlay()
 	}
 
 	SetComponentTickInterval(RelevantLightCheckRate);
+	VisibilityQueryParams = FCollisionQueryParams(GetOwner()->GetFName(), SCENE_QUERY_STAT_ONLY(KismetTraceUtils), false);
 
 	//Lazy "late begin play"
 	FTimerHandle Temp;
 	LXRSubsystem = GetOwner()->GetWorld()->GetSubsystem<ULXRSubsystem>();
+	LXRSubsystem->RegisterDetector(this);
+	if (RelevantTraceType == ERelevantTraceType::Pipelined)
+	{
+		LXRSubsystem->AddFrameSnapshotUser();
+		PipelineTraceDelegate.BindUObject(this, &ULXRDetectionComponent::OnPipelineTraceDone);
+	}
+	ResolvedVisibilityBackend = LXRSubsystem->ResolveVisibilityBackend(VisibilityBackend);
+	if (ResolvedVisibilityBackend == ELXRVisibilityBackend::OcclusionGrid)
+		LXRSubsystem->RequestOcclusionGrid();
+	LastBudgetServedTime = GetWorld()->GetTimeSeconds();
+
+	//Spread periodic work of detectors spawned in the same frame over different frames.
+	SchedulePhase = LXRSubsystem->AssignDetectorPhase();
+	GetCombinedDatasTimer = SchedulePhase * 0.1f;
+	NearSmartTimer = SchedulePhase * 0.2f / RelevancySmartCheckRateDivider;
+	MidSmartTimer = SchedulePhase * 0.5f / RelevancySmartCheckRateDivider;
+	FarSmartTimer = SchedulePhase * 1.f / RelevancySmartCheckRateDivider;
+	//Late begin play scans all lights, a spawn wave is spread over half a second instead of one check rate.
+	const float LateBeginPlayDelay = 0.1f + SchedulePhase * FMath::Max(RelevancyCheckRate, 0.5f);
+
 	GetWorld()->GetTimerManager().SetTimer(Temp, FTimerDelegate::CreateLambda([&]
 	{
-		GetLightSystemLights();
-		LXRSubsystem->OnLightAdded.AddUObject(this, &ULXRDetectionComponent::AddLight);
-		LXRSubsystem->OnLightRemoved.AddUObject(this, &ULXRDetectionComponent::RemoveLight);
+		LXRSubsystem->OnLightsAdded.AddUObject(this, &ULXRDetectionComponent::AddLights);
+		LXRSubsystem->OnLightsRemoved.AddUObject(this, &ULXRDetectionComponent::RemoveLights);
 
+		const TConstArrayView<TWeakObjectPtr<AActor>> AllLights = LXRSubsystem->GetAllLightsView();
 		for (int i = 0; i < AllLights.Num(); ++i)
 		{
-			if (Cast<ULXRSourceComponent>(AllLights[i]->GetComponentByClass(ULXRSourceComponent::StaticClass()))->bAlwaysRelevant)
+			if (AllLights[i].IsValid() && Cast<ULXRSourceComponent>(AllLights[i]->GetComponentByClass(ULXRSourceComponent::StaticClass()))->bAlwaysRelevant)
 			{
-				RelevantLights.Add(AllLights[i]);
+				if (FindLightPairSlot(AllLights[i].Get()) == INDEX_NONE)
+					AddLightPair(AllLights[i]);
 			}
 		}
 
@@ -99,6 +128,9 @@ void ULXRDetectionComponent::BeginPlay()
 				{
 					for (int i = 0; i < AllLights.Num(); ++i)
 					{
+						if (!AllLights[i].IsValid() || LXRSubsystem->IsLightInLightGrid(AllLights[i].Get()) || FindLightPairSlot(AllLights[i].Get()) != INDEX_NONE)
+							continue;
+
 						const ELightArrayType SmartArrayType = GetSmartArrayTypeForLightFromSqrDistance(FVector::DistSquared(AllLights[i].Get()->GetActorLocation(), GetOwner()->GetActorLocation()));
 						AddToSmartArrayBySmartArrayType(SmartArrayType, *AllLights[i]);
 					}
@@ -108,9 +140,9 @@ void ULXRDetectionComponent::BeginPlay()
 		}
 
 		SetComponentTickEnabled(true);
-	}), 0.1f, false);
+	}), LateBeginPlayDelay, false);
 
-	GetWorld()->GetTimerManager().SetTimer(CheckAllLightsTimerHandle, FTimerDelegate::CreateUObject(this, &ULXRDetectionComponent::CheckAllLightForRelevancy), RelevancyCheckRate, true, 0.15);
+	GetWorld()->GetTimerManager().SetTimer(CheckAllLightsTimerHandle, FTimerDelegate::CreateUObject(this, &ULXRDetectionComponent::CheckAllLightForRelevancy), RelevancyCheckRate, true, LateBeginPlayDelay + 0.05f);
 
 #if UE_ENABLE_DEBUG_DRAWING
 	if (bDebugVectorArray)
@@ -123,7 +155,8 @@ void ULXRDetectionComponent::BeginPlay()
 #endif
 	if (bGetIlluminatedTargets)
 	{
-		TArray<FVector> TraceTargets = GetTraceTargets(true);
+		FLXRTraceTargetArray TraceTargets;
+		GetTraceTargets(true, TraceTargets);
 		for (int i = 0; i < TraceTargets.Num(); ++i)
 		{
 			IlluminatedTargets.Add(i);
@@ -136,8 +169,14 @@ void ULXRDetectionComponent::BeginPlay()
 
 void ULXRDetectionComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	LXRSubsystem->OnLightAdded.RemoveAll(this);
-	LXRSubsystem->OnLightRemoved.RemoveAll(this);
+	LXRSubsystem->OnLightsAdded.RemoveAll(this);
+	LXRSubsystem->OnLightsRemoved.RemoveAll(this);
+	//Pipeline is reset regardless of trace type, a component that begins play again starts from Idle.
+	CancelRelevantCheckPipeline();
+	if (RelevantTraceType == ERelevantTraceType::Pipelined)
+		LXRSubsystem->RemoveFrameSnapshotUser();
+	LXRSubsystem->UnregisterDetector(this);
+	LeaveDormancy();
 	Super::EndPlay(EndPlayReason);
 }
 
@@ -148,10 +187,269 @@ void ULXRDetectionComponent::TickComponent(float DeltaTime, ELevelTick Tick, FAc
 	if (LXRSubsystem->bSoloFound)
 		GEngine->AddOnScreenDebugMessage(50, GetComponentTickInterval(), FColor::Red, FString::Printf(TEXT("SOLO LIGHT DETECTED! \n ONLY SOLO LIGHTS WILL WORK WITH LXR")));
 
-	CheckRelevantLights();
+	if (!ShouldEvaluateContinuously())
+	{
+		//Relevant checks of an on demand evaluation that did not fit in the trace budget are finished on later ticks.
+		if (DeferredRelevantLightBatch.Num() > 0)
+			FinishDeferredRelevantChecks();
+		return;
+	}
+
+	if (bAllowDormancy && UpdateDormancy(DeltaTime))
+		return;
+
+	if (LXRSubsystem->IsTraceBudgetEnabled())
+		LXRSubsystem->RequestDetectorUpdate(this);
+	else
+		CheckRelevantLights();
+
 	LastFrameDrawDebug = bDrawDebug;
 }
 
+void ULXRDetectionComponent::RequestLXR(FLinearColor& OutColor, float& OutIntensity, float StalenessTolerance)
+{
+	const float Tolerance = StalenessTolerance < 0 ? OnDemandStalenessTolerance : StalenessTolerance;
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	if (LastLXRUpdateTime < 0 || Now - LastLXRUpdateTime > Tolerance)
+		EvaluateLXRNow();
+
+	OutColor = CombinedLXRColor;
+	OutIntensity = CombinedLXRIntensity;
+}
+
+void ULXRDetectionComponent::AddLXRInterest(UObject* Interested)
+{
+	if (IsValid(Interested))
+		LXRInterests.AddUnique(Interested);
+}
+
+void ULXRDetectionComponent::RemoveLXRInterest(UObject* Interested)
+{
+	LXRInterests.RemoveSwap(Interested);
+}
+
+bool ULXRDetectionComponent::ShouldEvaluateContinuously()
+{
+	if (EvaluationMode == EDetectionEvaluationMode::Continuous)
+		return true;
+
+	LXRInterests.RemoveAllSwap([](const TWeakObjectPtr<UObject>& Interested)
+	{
+		return !Interested.IsValid();
+	}, false);
+
+	return LXRInterests.Num() > 0;
+}
+
+void ULXRDetectionComponent::EvaluateLXRNow()
+{
+	if (bStop || !IsValid(LXRSubsystem)) return;
+
+	RemoveRedundantLights();
+	AddNewLights();
+
+	//Result is needed right away, relevant checks are traced synchronously whatever RelevantTraceType is.
+	const double Now = GetWorld()->GetTimeSeconds();
+	const bool bScanRelevancy = LastOnDemandRelevancyScanTime < 0
+		|| Now - LastOnDemandRelevancyScanTime > OnDemandRelevancyScanInterval
+		|| OnDemandRelevancyLightsVersion != LXRSubsystem->GetLightsVersion()
+		|| (GetOwner()->GetActorLocation() - LastRelevancyUpdateLocation).Size() >= RelevancyLocationThreshold;
+	if (bScanRelevancy)
+		ScanAllLightsForRelevancy();
+
+	RelevantPairSlotBatch.Reset();
+	RelevantPairSlotBatch.Append(RelevantLightSlots);
+	for (const int32 DeferredSlot : DeferredRelevantLightBatch)
+	{
+		RelevantPairSlotBatch.AddUnique(DeferredSlot);
+	}
+	DeferredRelevantLightBatch.Reset();
+	ProcessRelevantCheckLightBatch(RelevantPairSlotBatch);
+	RemoveNonRelevantLights();
+
+	GetLXR();
+}
+
+void ULXRDetectionComponent::FinishDeferredRelevantChecks()
+{
+	if (bStop || !LXRSubsystem->HasTraceBudget())
+		return;
+
+	RelevantPairSlotBatch.Reset();
+	Swap(RelevantPairSlotBatch, DeferredRelevantLightBatch);
+	ProcessRelevantCheckLightBatch(RelevantPairSlotBatch);
+	RemoveNonRelevantLights();
+
+	GetLXR();
+}
+
+void ULXRDetectionComponent::ScanAllLightsForRelevancy()
+{
+	SCOPE_CYCLE_COUNTER(STAT_RelevancyCheck);
+
+	//Full pass over every light, ignoring batch sizes and Smart timers.
+	TArray<TWeakObjectPtr<AActor>>& LightBatch = RelevancyLightBatch;
+	const int AllLightsNum = LXRSubsystem->GetAllLightsView().Num();
+	int SharedLightCursor = -1;
+	switch (RelevancyCheckType)
+	{
+		case ERelevancyCheckType::Fixed:
+			GetNextSharedLightBatch(LightBatch, SharedLightCursor, AllLightsNum, false);
+			ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::All);
+			break;
+
+		case ERelevancyCheckType::Smart:
+			ApplySmartLightArrayChanges();
+			GetNextSharedLightBatch(LightBatch, SharedLightCursor, AllLightsNum, true);
+			ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::SmartFar);
+			ApplySmartLightArrayChanges();
+			LightBatch.Reset();
+			LightBatch.Append(SmartMidLights);
+			ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::SmartMid);
+			ApplySmartLightArrayChanges();
+			LightBatch.Reset();
+			LightBatch.Append(SmartNearLights);
+			ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::SmartNear);
+			ApplySmartLightArrayChanges();
+			break;
+
+		default: ;
+	}
+	AddLightGridRelevantLights();
+	LastRelevancyUpdateLocation = GetOwner()->GetActorLocation();
+	LastOnDemandRelevancyScanTime = GetWorld()->GetTimeSeconds();
+	OnDemandRelevancyLightsVersion = LXRSubsystem->GetLightsVersion();
+
+	RemoveNonRelevantLights();
+	AddNewRelevantLights();
+}
+
+bool ULXRDetectionComponent::IsDormant() const
+{
+	return bDormant;
+}
+
+void ULXRDetectionComponent::WakeUp()
+{
+	LeaveDormancy();
+	bDormancyWakeRequested = true;
+	DormancyStableTimer = 0;
+}
+
+void ULXRDetectionComponent::LeaveDormancy()
+{
+	bDormant = false;
+	for (const TWeakObjectPtr<ULXRSourceComponent>& ListenedSource : DormancyListenedSources)
+	{
+		if (ListenedSource.IsValid())
+			ListenedSource->RemoveDormantListener();
+	}
+	DormancyListenedSources.Reset();
+}
+
+bool ULXRDetectionComponent::UpdateDormancy(float DeltaTime)
+{
+	if (!IsDetectionStateStable())
+	{
+		LeaveDormancy();
+		DormancyStableTimer = 0;
+		return false;
+	}
+
+	if (bDormant)
+	{
+		DormantTimer += DeltaTime;
+		if (MaxDormantTime > 0 && DormantTimer > MaxDormantTime)
+		{
+			WakeUp();
+			return false;
+		}
+		return true;
+	}
+
+	DormancyStableTimer += DeltaTime;
+	if (DormancyStableTimer < DormancyStableTime)
+		return false;
+
+	bDormant = true;
+	DormantTimer = 0;
+
+	DormancyArea = FBox(ForceInit);
+	DormancyArea += GetOwner()->GetActorLocation();
+	for (const int32 PairSlot : RelevantLightSlots)
+	{
+		const TWeakObjectPtr<AActor>& RelevantLight = LightPairs[PairSlot].LightSourceOwner;
+		if (RelevantLight.IsValid())
+			DormancyArea += RelevantLight->GetActorLocation();
+
+		//Sources tick slowly when static, listeners make switched off lights show up within a few frames.
+		ULXRSourceComponent* LightSourceComponent = LightPairs[PairSlot].LightSourceComponent.Get();
+		if (IsValid(LightSourceComponent))
+		{
+			LightSourceComponent->AddDormantListener();
+			DormancyListenedSources.Add(LightSourceComponent);
+		}
+	}
+
+	return true;
+}
+
+bool ULXRDetectionComponent::IsDetectionStateStable()
+{
+	const FTransform& OwnerTransform = GetOwner()->GetActorTransform();
+
+	bool bStable = !bDormancyWakeRequested
+		//While dormant, AddLights and RemoveLights wake component for lights that matter to it.
+		&& (bDormant || (NewAllLightsToAdd.Num() == 0 && LightsToRemove.Num() == 0))
+		&& NewRelevantLightsToAdd.Num() == 0 && RelevantLightsToRemove.Num() == 0
+		&& DeferredRelevantLightBatch.Num() == 0
+		&& OwnerTransform.GetLocation().Equals(DormancyTransform.GetLocation(), DormancyLocationThreshold)
+		&& OwnerTransform.GetRotation().AngularDistance(DormancyTransform.GetRotation()) <= FMath::DegreesToRadians(DormancyRotationThreshold);
+
+	const uint32 LightsHash = GetRelevantLightsChangeHash();
+	bStable = bStable && LightsHash == DormancyLightsHash;
+
+	//Owner transform covers all other target types, sockets move with the pose.
+	FLXRTraceTargetArray TraceTargets;
+	if (RelevantTargetType == ETraceTarget::Sockets)
+	{
+		GetTraceTargets(true, TraceTargets);
+		bStable = bStable && TraceTargets.Num() == DormancyTraceTargets.Num();
+		for (int i = 0; bStable && i < TraceTargets.Num(); ++i)
+		{
+			bStable = TraceTargets[i].Equals(DormancyTraceTargets[i], DormancyLocationThreshold);
+		}
+	}
+
+	if (!bStable)
+	{
+		bDormancyWakeRequested = false;
+		DormancyTransform = OwnerTransform;
+		DormancyLightsHash = LightsHash;
+		DormancyTraceTargets = TraceTargets;
+	}
+
+	return bStable;
+}
+
+uint32 ULXRDetectionComponent::GetRelevantLightsChangeHash() const
+{
+	uint32 Hash = GetTypeHash(RelevantLightSlots.Num());
+	for (const int32 PairSlot : RelevantLightSlots)
+	{
+		const FLXRLightPair& LightPair = LightPairs[PairSlot];
+		if (!LightPair.LightSourceOwner.IsValid())
+			continue;
+
+		Hash = HashCombine(Hash, GetTypeHash(LightPair.LightSourceOwner));
+		const ULXRSourceComponent* LightSourceComponent = LightPair.LightSourceComponent.Get();
+		if (IsValid(LightSourceComponent))
+			Hash = HashCombine(Hash, LightSourceComponent->GetChangeGeneration());
+	}
+	return Hash;
+}
+
 ELightArrayType ULXRDetectionComponent::GetSmartArrayTypeForLight(const FVector& Start, const FVector& End) const
 {
 	const float DistSqr = FVector::DistSquared(Start, End);
@@ -160,18 +458,19 @@ ELightArrayType ULXRDetectionComponent::GetSmartArrayTypeForLight(const FVector&
 
 void ULXRDetectionComponent::AddToSmartArrayBySmartArrayType(ELightArrayType LightArrayType, AActor& LightSourceActor)
 {
+	//Far lights are not tracked, Far check walks subsystem light list.
 	switch (LightArrayType)
 	{
-		case ELightArrayType::SmartFar:
-			SmartFarLightsToAdd.AddUnique(&LightSourceActor);
-			break;
 		case ELightArrayType::SmartMid:
 			SmartMidLightsToAdd.AddUnique(&LightSourceActor);
+			SmartTrackedLights.Add(&LightSourceActor, ELightArrayType::SmartMid);
 			break;
 		case ELightArrayType::SmartNear:
 			SmartNearLightsToAdd.AddUnique(&LightSourceActor);
+			SmartTrackedLights.Add(&LightSourceActor, ELightArrayType::SmartNear);
 			break;
-		default: ;
+		default:
+			SmartTrackedLights.Remove(&LightSourceActor);
 	}
 }
 
@@ -237,12 +536,27 @@ ELightArrayType ULXRDetectionComponent::GetSmartArrayTypeForLightFromSqrDistance
 	return ELightArrayType::SmartNear;
 }
 
-FCollisionQueryParams ULXRDetectionComponent::GetCollisionQueryParams(const TArray<AActor*>& ActorsToIgnore) const
+const FCollisionQueryParams& ULXRDetectionComponent::GetVisibilityQueryParams(const AActor& LightSourceOwner) const
 {
-	FCollisionQueryParams Params(GetOwner()->GetFName(), SCENE_QUERY_STAT_ONLY(KismetTraceUtils), false);
+	//ClearIgnoredActors keeps the allocation, so after warm up this does not allocate.
+	VisibilityQueryParams.ClearIgnoredActors();
+
+	ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSourceOwner.GetComponentByClass(ULXRSourceComponent::StaticClass()));
+	if (IsValid(LightSourceComponent))
+	{
+		for (const TWeakObjectPtr<AActor>& OverlappingActor : LightSourceComponent->GetMyOverlappingActors())
+		{
+			if (OverlappingActor.IsValid())
+				VisibilityQueryParams.AddIgnoredActor(OverlappingActor.Get());
+		}
+		for (AActor* IgnoredActor : LightSourceComponent->GetVisibilityIgnoredActors())
+			VisibilityQueryParams.AddIgnoredActor(IgnoredActor);
+	}
+	VisibilityQueryParams.AddIgnoredActors(IgnoreVisibilityActors);
 
-	Params.AddIgnoredActors(ActorsToIgnore);
-	return Params;
+	VisibilityQueryParams.AddIgnoredActor(GetOwner());
+	VisibilityQueryParams.AddIgnoredActor(&LightSourceOwner);
+	return VisibilityQueryParams;
 }
 
 
@@ -251,22 +565,19 @@ void ULXRDetectionComponent::ChangeSmartLightArray(const ELightArrayType& From,
 	if (From == To) return;
 	switch (To)
 	{
-		case ELightArrayType::SmartFar:
-			SmartFarLightsToAdd.AddUnique(LightSourceOwner);
-			break;
 		case ELightArrayType::SmartMid:
 			SmartMidLightsToAdd.AddUnique(LightSourceOwner);
+			SmartTrackedLights.Add(LightSourceOwner, ELightArrayType::SmartMid);
 			break;
 		case ELightArrayType::SmartNear:
 			SmartNearLightsToAdd.AddUnique(LightSourceOwner);
+			SmartTrackedLights.Add(LightSourceOwner, ELightArrayType::SmartNear);
 			break;
-		default: ;
+		default:
+			SmartTrackedLights.Remove(LightSourceOwner);
 	}
 	switch (From)
 	{
-		case ELightArrayType::SmartFar:
-			SmartFarLightsToRemove.AddUnique(LightSourceOwner);
-			break;
 		case ELightArrayType::SmartMid:
 			SmartMidLightsToRemove.AddUnique(LightSourceOwner);
 			break;
@@ -279,7 +590,7 @@ void ULXRDetectionComponent::ChangeSmartLightArray(const ELightArrayType& From,
 
 void ULXRDetectionComponent::CheckAllLightForRelevancy()
 {
-	if (bStop) return;
+	if (bStop || bDormant || !ShouldEvaluateContinuously()) return;
 
 	RemoveRedundantLights();
 	AddNewLights();
@@ -295,16 +606,12 @@ void ULXRDetectionComponent::CheckAllLightForRelevancy()
 
 	SCOPE_CYCLE_COUNTER(STAT_RelevancyCheck);
 
-	TArray<int> StaleLightsIndexes;
-	TArray<TWeakObjectPtr<AActor>> LightBatch;
+	TArray<TWeakObjectPtr<AActor>>& LightBatch = RelevancyLightBatch;
 
 	switch (RelevancyCheckType)
 	{
 		case ERelevancyCheckType::Fixed:
 			{
-				if (!AllLights.IsValidIndex(RelevancyLightIndex))
-					RelevancyLightIndex = 0;
-
 				GetNextBatchByLightArrayType(LightBatch, ELightArrayType::All);
 				ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::All);
 				break;
@@ -312,42 +619,7 @@ void ULXRDetectionComponent::CheckAllLightForRelevancy()
 
 		case ERelevancyCheckType::Smart:
 			{
-				for (int i = SmartFarLightsToRemove.Num() - 1; i >= 0; --i)
-				{
-					SmartFarLights.RemoveSwap(SmartFarLightsToRemove[i]);
-				}
-
-				for (int i = SmartMidLightsToRemove.Num() - 1; i >= 0; --i)
-				{
-					SmartMidLights.RemoveSwap(SmartMidLightsToRemove[i]);
-				}
-
-				for (int i = SmartNearLightsToRemove.Num() - 1; i >= 0; --i)
-				{
-					SmartNearLights.RemoveSwap(SmartNearLightsToRemove[i]);
-				}
-
-				for (int i = SmartFarLightsToAdd.Num() - 1; i >= 0; --i)
-				{
-					SmartFarLights.Add(SmartFarLightsToAdd[i]);
-				}
-
-				for (int i = SmartMidLightsToAdd.Num() - 1; i >= 0; --i)
-				{
-					SmartMidLights.Add(SmartMidLightsToAdd[i]);
-				}
-
-				for (int i = SmartNearLightsToAdd.Num() - 1; i >= 0; --i)
-				{
-					SmartNearLights.Add(SmartNearLightsToAdd[i]);
-				}
-
-				SmartFarLightsToRemove.Empty();
-				SmartMidLightsToRemove.Empty();
-				SmartNearLightsToRemove.Empty();
-				SmartFarLightsToAdd.Empty();
-				SmartMidLightsToAdd.Empty();
-				SmartNearLightsToAdd.Empty();
+				ApplySmartLightArrayChanges();
 
 				NearSmartTimer += RelevancyCheckRate;
 				NearSmartTimer += RelevancyCheckRate;
@@ -356,11 +628,9 @@ void ULXRDetectionComponent::CheckAllLightForRelevancy()
 
 				if (FarSmartTimer > 1 / RelevancySmartCheckRateDivider)
 				{
-					if (SmartFarLights.Num() > 0)
-					{
-						GetNextBatchByLightArrayType(LightBatch, ELightArrayType::SmartFar);
+					GetNextBatchByLightArrayType(LightBatch, ELightArrayType::SmartFar);
+					if (LightBatch.Num() > 0)
 						ProcessRelevancyCheckLightBatch(LightBatch, ELightArrayType::SmartFar);
-					}
 					FarSmartTimer = 0;
 				}
 
@@ -391,21 +661,76 @@ void ULXRDetectionComponent::CheckAllLightForRelevancy()
 		default: ;
 	}
 
+	AddLightGridRelevantLights();
 	LastRelevancyUpdateLocation = GetOwner()->GetActorLocation();
 
-	SET_DWORD_STAT(STAT_ALLLIGHTS, AllLights.Num());
+	const int AllLightsNum = LXRSubsystem->GetAllLightsView().Num();
+	SET_DWORD_STAT(STAT_ALLLIGHTS, AllLightsNum);
 	SET_DWORD_STAT(STAT_SMARTNEAR, SmartNearLights.Num());
 	SET_DWORD_STAT(STAT_SMARTMID, SmartMidLights.Num());
-	SET_DWORD_STAT(STAT_SMARTFAR, SmartFarLights.Num());
+	SET_DWORD_STAT(STAT_SMARTFAR, FMath::Max(AllLightsNum - SmartTrackedLights.Num(), 0));
+}
+
+void ULXRDetectionComponent::ApplySmartLightArrayChanges()
+{
+	for (int i = SmartMidLightsToRemove.Num() - 1; i >= 0; --i)
+	{
+		SmartMidLights.RemoveSwap(SmartMidLightsToRemove[i]);
+	}
+
+	for (int i = SmartNearLightsToRemove.Num() - 1; i >= 0; --i)
+	{
+		SmartNearLights.RemoveSwap(SmartNearLightsToRemove[i]);
+	}
+
+	for (int i = SmartMidLightsToAdd.Num() - 1; i >= 0; --i)
+	{
+		SmartMidLights.AddUnique(SmartMidLightsToAdd[i]);
+	}
+
+	for (int i = SmartNearLightsToAdd.Num() - 1; i >= 0; --i)
+	{
+		SmartNearLights.AddUnique(SmartNearLightsToAdd[i]);
+	}
+
+	SmartMidLightsToRemove.Reset();
+	SmartNearLightsToRemove.Reset();
+	SmartMidLightsToAdd.Reset();
+	SmartNearLightsToAdd.Reset();
 }
 
 void ULXRDetectionComponent::AddLightToNewRelevantList(const TWeakObjectPtr<AActor>& LightSourceOwner)
 {
 	NewRelevantLightsToAdd.AddUnique(LightSourceOwner);
+	SmartTrackedLights.Add(LightSourceOwner, ELightArrayType::Relevant);
 	if (bPrintDebug)
 		UE_LOG(LogLightSystem, Warning, TEXT("Added relevant light %s to %s"), *LightSourceOwner->GetName(), *GetOwner()->GetName());
 }
 
+void ULXRDetectionComponent::AddLightGridRelevantLights()
+{
+	if (!LXRSubsystem->HasLightGrids())
+		return;
+
+	LightGridCellLights.Reset();
+	LXRSubsystem->GetLightGridLights(GetOwner()->GetActorLocation(), LightGridCellLights);
+	for (AActor* Light : LightGridCellLights)
+	{
+		if (FindLightPairSlot(Light) != INDEX_NONE)
+			continue;
+
+		const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(Light->GetComponentByClass(ULXRSourceComponent::StaticClass()));
+		if (!IsValid(LightSourceComponent) || (LXRSubsystem->bSoloFound && !LightSourceComponent->bSolo))
+			continue;
+
+		//Cell is coarse, light must pass the same relevancy test as scanned lights or it would fail and be removed again.
+		FLXRIndexArray PassedComponents;
+		FLXRIndexArray PassedTargets;
+		if (CheckIsLightRelevant(*LightSourceComponent, PassedComponents, PassedTargets))
+			AddLightToNewRelevantList(Light);
+	}
+}
+
 void ULXRDetectionComponent::ProcessRelevancyCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& LightBatch, ELightArrayType LightArrayType)
 {
 	switch (RelevancyCheckType)
@@ -417,7 +742,7 @@ void ULXRDetectionComponent::ProcessRelevancyCheckLightBatch(TArray<TWeakObjectP
 				const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightBatch[i].Get()->GetComponentByClass(ULXRSourceComponent::StaticClass()));
 				if (IsValid(LightSourceComponent))
 				{
-					if (!RelevantLights.Contains(LightSourceComponent->GetOwner()))
+					if (FindLightPairSlot(LightSourceComponent->GetOwner()) == INDEX_NONE)
 					{
 						bool bIsRelevant = LightSourceComponent->bAlwaysRelevant;
 						if (!bIsRelevant)
@@ -493,13 +818,13 @@ void ULXRDetectionComponent::ProcessRelevancyCheckLightBatch(TArray<TWeakObjectP
 								{
 									if (DistSqr < RelevancySmartDistanceMax * RelevancySmartDistanceMax)
 									{
-										if (!RelevantLights.Contains(LightSourceComponent->GetOwner()))
+										if (FindLightPairSlot(LightSourceComponent->GetOwner()) == INDEX_NONE)
 										{
 											bool bIsRelevant = LightSourceComponent->bAlwaysRelevant;
 
 											if (!bIsRelevant)
 											{
-												TArray<int> PassedComponents;
+												FLXRIndexArray PassedComponents;
 												bIsRelevant = CheckIsLightRelevant(*LightSourceComponent, PassedComponents, PassedComponents, false, false);
 											}
 
@@ -540,12 +865,12 @@ void ULXRDetectionComponent::ProcessRelevancyCheckLightBatch(TArray<TWeakObjectP
 									continue;
 								}
 
-								if (!RelevantLights.Contains(LightSourceComponent->GetOwner()))
+								if (FindLightPairSlot(LightSourceComponent->GetOwner()) == INDEX_NONE)
 								{
 									bool bIsRelevant = LightSourceComponent->bAlwaysRelevant;
 									if (!bIsRelevant)
 									{
-										TArray<int> PassedComponents;
+										FLXRIndexArray PassedComponents;
 										bIsRelevant = CheckIsLightRelevant(*LightSourceComponent, PassedComponents, PassedComponents, false, false);
 									}
 
@@ -565,8 +890,18 @@ void ULXRDetectionComponent::ProcessRelevancyCheckLightBatch(TArray<TWeakObjectP
 	}
 }
 
-void ULXRDetectionComponent::DoRelevantCheckOnSourceActor(const TWeakObjectPtr<AActor>& LightSourceComponentOwner, bool IsFromThread, bool IsLightSenseCheck)
+void ULXRDetectionComponent::DoRelevantCheckOnLightPair(int32 PairSlot, FLXRRelevantCheckResult& OutResult, bool IsFromThread, bool IsLightSenseCheck)
 {
+	OutResult.PairSlot = PairSlot;
+	OutResult.PassedComponents.Reset();
+	OutResult.bChecked = false;
+	OutResult.bPassed = false;
+	OutResult.bStillRelevant = true;
+
+	if (!LightPairs.IsValidIndex(PairSlot))
+		return;
+
+	const TWeakObjectPtr<AActor> LightSourceComponentOwner = LightPairs[PairSlot].LightSourceOwner;
 	if (!LightSourceComponentOwner.IsValid())
 	{
 		return;
@@ -575,8 +910,11 @@ void ULXRDetectionComponent::DoRelevantCheckOnSourceActor(const TWeakObjectPtr<A
 	if (GetOwner() == LightSourceComponentOwner)
 		return;
 
-	const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSourceComponentOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()));
-	const TArray<ULightComponent*> LightComponents = LightSourceComponent->GetMyLightComponents();
+	const ULXRSourceComponent* LightSourceComponent = LightPairs[PairSlot].LightSourceComponent.Get();
+	if (!IsValid(LightSourceComponent))
+		return;
+
+	const TArray<ULightComponent*>& LightComponents = LightSourceComponent->GetMyLightComponents();
 	const bool IsLightSourceEnabled = LightSourceComponent->IsEnabled();
 	if (LXRSubsystem->bSoloFound)
 	{
@@ -585,52 +923,64 @@ void ULXRDetectionComponent::DoRelevantCheckOnSourceActor(const TWeakObjectPtr<A
 	}
 
 	bool IsRelevant = false;
-	TArray<int> PassedComponents;
-	TArray<int> PassedTargets;
+	FLXRIndexArray& PassedComponents = OutResult.PassedComponents;
+	FLXRIndexArray PassedTargets;
 
 	if (IsLightSourceEnabled)
 	{
 		IsRelevant = CheckIsLightRelevant(*LightSourceComponent, PassedComponents, PassedTargets, IsLightSenseCheck, IsFromThread);
 	}
 
-	// const bool ShouldCheckVisibility = IsRelevant || UpdateMemory;
-
 	if (IsRelevant)
 	{
-		// if (!IsRelevant)
-		// {
-		// 	for (int i = 0; i < LightComponents.Num(); ++i)
-		// 	{
-		// 		PassedComponents.AddUnique(i);
-		// 	}
-		// }
-
-		if (CheckVisibility(LightComponents, PassedComponents, PassedTargets, IsLightSenseCheck))
+		if (CheckVisibility(LightComponents, PassedComponents, PassedTargets, &LightPairs[PairSlot], IsLightSenseCheck))
 		{
-			if (IsLightSourceEnabled)
-			{
-				LightPassed(LightSourceComponentOwner, PassedComponents);
-			}
+			OutResult.bPassed = IsLightSourceEnabled;
 		}
 		else
 		{
-			PassedComponents.Empty();
+			PassedComponents.Reset();
 		}
 	}
 
-	if (PassedComponents.Num() == 0)
+	OutResult.bAlwaysRelevant = LightSourceComponent->bAlwaysRelevant;
+	if (PassedComponents.Num() == 0 && !OutResult.bAlwaysRelevant && LightPairs[PairSlot].ConsecutiveFails + 1 > MaxConsecutiveFails)
+	{
+		FLXRIndexArray RelevancyPassedComponents;
+		FLXRIndexArray RelevancyPassedTargets;
+		OutResult.bStillRelevant = CheckIsLightRelevant(*LightSourceComponent, RelevancyPassedComponents, RelevancyPassedTargets, false, IsFromThread);
+	}
+
+	OutResult.bChecked = true;
+}
+
+void ULXRDetectionComponent::ApplyRelevantCheckResult(const FLXRRelevantCheckResult& Result)
+{
+	if (!Result.bChecked || !LightPairs.IsValidIndex(Result.PairSlot))
+		return;
+
+	const int32 PairSlot = Result.PairSlot;
+	LightPairs[PairSlot].LastCheckTime = GetWorld()->GetTimeSeconds();
+
+	if (Result.bPassed)
+		LightPassed(PairSlot, Result.PassedComponents);
+
+	FLXRLightPair& LightPair = LightPairs[PairSlot];
+	LightPair.FailHistory = LightPair.FailHistory << 1 | (Result.PassedComponents.Num() == 0 ? 1 : 0);
+
+	if (Result.PassedComponents.Num() == 0)
 	{
-		if (LightSourceComponent->bAlwaysRelevant)
+		if (Result.bAlwaysRelevant)
 		{
-			RemovePassedLight(LightSourceComponentOwner);
+			RemovePassedLight(PairSlot);
 		}
 		else
 		{
-			IsFromThread ? IncreaseFailCountIfNotAlwaysRelevantLightFromThread(LightSourceComponentOwner) : IncreaseFailCount(LightSourceComponentOwner);
+			IncreaseFailCount(PairSlot);
 
-			if (RelevantLightsFailCounts[LightSourceComponentOwner] > MaxConsecutiveFails)
+			if (LightPair.ConsecutiveFails > MaxConsecutiveFails && !Result.bStillRelevant)
 			{
-				IsFromThread ? CheckAndRemoveIfLightNotRelevantFromThread(LightSourceComponentOwner) : CheckAndRemoveIfLightNotRelevant(LightSourceComponentOwner);
+				RemoveNotRelevantLight(PairSlot);
 			}
 		}
 	}
@@ -639,12 +989,13 @@ void ULXRDetectionComponent::DoRelevantCheckOnSourceActor(const TWeakObjectPtr<A
 void ULXRDetectionComponent::GetLXR()
 {
 	SCOPE_CYCLE_COUNTER(STAT_GetCombinedDatas);
-	CombinedLightColors.Empty();
+	LastLXRUpdateTime = GetWorld()->GetTimeSeconds();
+	CombinedLightColors.Reset();
 	CombinedLXRColor = FLinearColor::Black;
 	CombinedLXRIntensity = 0;
-	TArray<FVector> TraceTargets;
+	FLXRTraceTargetArray TraceTargets;
 	// TraceTargets.Add(GetOwner()->GetActorLocation());
-	TraceTargets = GetTraceTargets(true);
+	GetTraceTargets(true, TraceTargets);
 	if (bGetIlluminatedTargets)
 	{
 		// TraceTargets = GetTraceTargets(true);
@@ -653,7 +1004,7 @@ void ULXRDetectionComponent::GetLXR()
 		{
 			TargetsCombinedLXRColor[It.Key()] = FLinearColor::Black;
 			TargetsCombinedLXRIntensity[It.Key()] = 0;
-			TargetsCombinedLightColors[It.Key()].Empty();
+			TargetsCombinedLightColors[It.Key()].Reset();
 		}
 	}
 #if UE_ENABLE_DEBUG_DRAWING
@@ -667,18 +1018,21 @@ void ULXRDetectionComponent::GetLXR()
 #endif
 
 
-	for (int i = RelevantLightsPassed.Num() - 1; i >= 0; --i)
+	for (int i = PassedLightSlots.Num() - 1; i >= 0; --i)
 	{
-		TWeakObjectPtr<AActor> LightActor = RelevantLightsPassed[i];
-		if (IsValid(LightActor.Get()))
+		FLXRLightPair& LightPair = LightPairs[PassedLightSlots[i]];
+		const ULXRSourceComponent* LightSourceComponent = LightPair.LightSourceComponent.Get();
+		if (LightPair.LightSourceOwner.IsValid() && IsValid(LightSourceComponent))
 		{
-			const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightActor->GetComponentByClass(ULXRSourceComponent::StaticClass()));
-			TArray<ULightComponent*> LightComponents = LightSourceComponent->GetMyLightComponents();
-
-			TArray<int> PassedComps = LightsPassedComponents[LightActor];
+			const TArray<ULightComponent*>& LightComponents = LightSourceComponent->GetMyLightComponents();
+			LightPair.LastContribution = 0;
 
-			for (const int CompIndex : PassedComps)
+			for (TConstSetBitIterator<TInlineAllocator<1>> PassedIt(LightPair.PassedComponents); PassedIt; ++PassedIt)
 			{
+				const int CompIndex = PassedIt.GetIndex();
+				if (!LightComponents.IsValidIndex(CompIndex))
+					continue;
+
 				float Multiplier = 1;
 				float ColorMultiplier = 1;
 				if (LightSourceComponent->LightLXRMultipliers.Num() == 0)
@@ -804,8 +1158,10 @@ void ULXRDetectionComponent::GetLXR()
 
 					if (j == 0)
 					{
+						const float Contribution = FMath::Min(AfterDivideIntensity * 1500.f, 1.f) * Multiplier;
 						CombinedLightColors.Add(LightColor);
-						CombinedLXRIntensity += FMath::Min(AfterDivideIntensity * 1500.f, 1.f) * Multiplier;
+						CombinedLXRIntensity += Contribution;
+						LightPair.LastContribution += Contribution;
 					}
 					else
 					{
@@ -861,11 +1217,20 @@ void ULXRDetectionComponent::GetLXR()
 	// DrawDebugSphere(GetWorld(), GetOwner()->GetActorLocation(), 100, 20, CombinedLightColor.ToFColor(false), false, RelevantTraceType == ERelevantTraceType::Async ? GetWorld()->DeltaTimeSeconds : GetComponentTickInterval(), 0, 1);
 }
 
-void ULXRDetectionComponent::ProcessRelevantCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& LightBatch, bool IsLightSenseCheck)
+void ULXRDetectionComponent::ProcessRelevantCheckLightBatch(TArray<int32>& PairSlotBatch, bool IsLightSenseCheck)
 {
-	for (TWeakObjectPtr<AActor> LightSourceComponentOwner : LightBatch)
+	RelevantCheckResults.SetNum(PairSlotBatch.Num(), false);
+	int CheckedCount = 0;
+	for (int i = 0; i < PairSlotBatch.Num(); ++i)
 	{
-		DoRelevantCheckOnSourceActor(LightSourceComponentOwner, false, IsLightSenseCheck);
+		if (!LXRSubsystem->HasTraceBudget())
+		{
+			DeferredRelevantLightBatch.Append(&PairSlotBatch[i], PairSlotBatch.Num() - i);
+			break;
+		}
+
+		DoRelevantCheckOnLightPair(PairSlotBatch[i], RelevantCheckResults[i], false, IsLightSenseCheck);
+		CheckedCount++;
 		// if (!LightSourceComponentOwner.IsValid())
 		// {
 		// 	continue;
@@ -977,6 +1342,12 @@ void ULXRDetectionComponent::ProcessRelevantCheckLightBatch(TArray<TWeakObjectPt
 		// 	}
 		// }
 	}
+
+	//Results are applied only after every check of the batch ran, checks never see each other's state changes.
+	for (int i = 0; i < CheckedCount; ++i)
+	{
+		ApplyRelevantCheckResult(RelevantCheckResults[i]);
+	}
 }
 
 void ULXRDetectionComponent::CheckRelevantLights()
@@ -991,6 +1362,11 @@ void ULXRDetectionComponent::CheckRelevantLights()
 		SET_DWORD_STAT(STAT_TRACESSYNC, 0);
 		SET_DWORD_STAT(STAT_TRACESMULTITHREAD, 0);
 		SET_DWORD_STAT(STAT_THREADS, 0);
+		SET_DWORD_STAT(STAT_VISIBILITYCACHEHITS, 0);
+		SET_DWORD_STAT(STAT_OCCLUDERBVHRAYS, 0);
+		SET_DWORD_STAT(STAT_OCCLUSIONGRIDRAYS, 0);
+		SET_DWORD_STAT(STAT_OCCLUSIONMAPSAMPLES, 0);
+		SET_DWORD_STAT(STAT_SUNHEIGHTFIELDSAMPLES, 0);
 
 		StatResetTimer = 0;
 	}
@@ -1005,24 +1381,26 @@ void ULXRDetectionComponent::CheckRelevantLights()
 
 	if (bPrintDebug)
 	{
-		GEngine->AddOnScreenDebugMessage(97, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("Relevant Lights: %d"), RelevantLights.Num()));
-		GEngine->AddOnScreenDebugMessage(98, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("Passed Lights: %d"), RelevantLightsPassed.Num()));
-		GEngine->AddOnScreenDebugMessage(99, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("All Lights: %d"), AllLights.Num()));
+		GEngine->AddOnScreenDebugMessage(97, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("Relevant Lights: %d"), RelevantLightSlots.Num()));
+		GEngine->AddOnScreenDebugMessage(98, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("Passed Lights: %d"), PassedLightSlots.Num()));
+		GEngine->AddOnScreenDebugMessage(99, GetWorld()->DeltaTimeSeconds, FColor::Green, FString::Printf(TEXT("All Lights: %d"), LXRSubsystem->GetAllLightsView().Num()));
 	}
 
 #if UE_ENABLE_DEBUG_DRAWING
 	if (bDebugRelevantAndPassed)
 	{
-		for (auto RelevantLight : RelevantLights)
+		for (const int32 PairSlot : RelevantLightSlots)
 		{
+			const TWeakObjectPtr<AActor>& RelevantLight = LightPairs[PairSlot].LightSourceOwner;
 			if (RelevantLight.IsValid())
 			{
 				DrawDebugBox(GetWorld(), RelevantLight->GetActorLocation(), FVector(25), FColor::Orange, false, GetComponentTickInterval());
 				DrawDebugDirectionalArrow(GetWorld(), GetOwner()->GetActorLocation(), RelevantLight->GetActorLocation(), 150, FColor::Orange, false, GetComponentTickInterval(), 0, 0);
 			}
 		}
-		for (auto PassedLight : RelevantLightsPassed)
+		for (const int32 PairSlot : PassedLightSlots)
 		{
+			const TWeakObjectPtr<AActor>& PassedLight = LightPairs[PairSlot].LightSourceOwner;
 			if (PassedLight.IsValid())
 			{
 				DrawDebugBox(GetWorld(), PassedLight->GetActorLocation(), FVector(15), FColor::Cyan, false, GetComponentTickInterval());
@@ -1034,51 +1412,446 @@ void ULXRDetectionComponent::CheckRelevantLights()
 
 	RemoveNonRelevantLights();
 	AddNewRelevantLights();
-	TArray<TWeakObjectPtr<AActor>> LightBatch;
-	GetNextRelevantCheckLightBatch(LightBatch);
 
-	ProcessRelevantCheckLightBatch(LightBatch);
+	if (RelevantTraceType == ERelevantTraceType::Pipelined)
+	{
+		TickRelevantCheckPipeline();
+	}
+	else if (RelevantTraceType == ERelevantTraceType::ParallelFor)
+	{
+		QueueParallelRelevantChecks();
+	}
+	else
+	{
+		RelevantPairSlotBatch.Reset();
+		if (DeferredRelevantLightBatch.Num() > 0)
+		{
+			//Swap keeps both allocations alive for the next checks.
+			Swap(RelevantPairSlotBatch, DeferredRelevantLightBatch);
+		}
+		else
+			GetNextRelevantCheckLightBatch(RelevantPairSlotBatch);
+
+		ProcessRelevantCheckLightBatch(RelevantPairSlotBatch);
+	}
 
-	SET_DWORD_STAT(STAT_RELEVANTLIGHTS, RelevantLights.Num());
-	SET_DWORD_STAT(STAT_PASSEDRELEVANTLIGHTS, RelevantLightsPassed.Num());
+	SET_DWORD_STAT(STAT_RELEVANTLIGHTS, RelevantLightSlots.Num());
+	SET_DWORD_STAT(STAT_PASSEDRELEVANTLIGHTS, PassedLightSlots.Num());
 }
 
-
-TArray<TWeakObjectPtr<AActor>>& ULXRDetectionComponent::GetLightArrayByLightArrayType(ELightArrayType LightArrayType)
+void ULXRDetectionComponent::TickRelevantCheckPipeline()
 {
-	switch (LightArrayType)
+	switch (PipelineStage)
 	{
-		case ELightArrayType::All:
-			return AllLights;
-
-		case ELightArrayType::Relevant:
-			return RelevantLights;
-
-		case ELightArrayType::SmartFar:
-			return SmartFarLights;
+		case ELXRPipelineStage::Idle:
+			StartPipelineCulling();
+			break;
 
-		case ELightArrayType::SmartMid:
-			return SmartMidLights;
+		case ELXRPipelineStage::Culling:
+			//Culling task overlaps with the rest of the frame, it is not waited on.
+			if (PipelineCullTask.IsCompleted())
+				SubmitPipelineTraces();
+			break;
 
-		case ELightArrayType::SmartNear:
-			return SmartNearLights;
+		case ELXRPipelineStage::Tracing:
+			if (PendingPipelineTraces == 0)
+			{
+				ApplyPipelineResults(PipelineTraceVisible);
+				StartPipelineCulling();
+			}
+			else if (GFrameCounter - PipelineTraceFrame > MaxPipelineTraceFrames)
+			{
+				//Some traces never came back, results of the batch are incomplete. Pairs keep their last results until the batch cursor reaches them again.
+				ResetRelevantCheckPipeline();
+				StartPipelineCulling();
+			}
+			break;
 
 		default: ;
 	}
-
-	return AllLights;
 }
 
-void ULXRDetectionComponent::GetNextBatchByLightArrayType(TArray<TWeakObjectPtr<AActor>>& OutLightBatch, ELightArrayType LightArrayType)
+void ULXRDetectionComponent::StartPipelineCulling()
 {
-	const bool bIsRelevancyCheck = LightArrayType < ELightArrayType::Relevant;
-	const int BatchCount = bIsRelevancyCheck ? RelevancyLightBatchCount : RelevantLightBatchCount;
-	TArray<TWeakObjectPtr<AActor>>& Array = GetLightArrayByLightArrayType(LightArrayType);
-	OutLightBatch.Empty();
+	PipelineStage = ELXRPipelineStage::Idle;
+	if (!LXRSubsystem->HasTraceBudget())
+		return;
 
-	int Index = GetCurrentLightArrayIndexByLightArrayType(LightArrayType);
-	// GEngine->AddOnScreenDebugMessage(1, GetWorld()->DeltaTimeSeconds, FColor::Red, FString::Printf(TEXT("Start")));
-	if (!Array.IsValidIndex(Index))
+	const FLXRFrameSnapshot& Snapshot = LXRSubsystem->GetFrameSnapshot();
+	const FLXRDetectorRecord* Detector = Snapshot.FindDetector(this);
+	//First snapshot including this component is published at end of this frame.
+	if (!Detector)
+		return;
+
+	RelevantPairSlotBatch.Reset();
+	if (DeferredRelevantLightBatch.Num() > 0)
+		Swap(RelevantPairSlotBatch, DeferredRelevantLightBatch);
+	else
+		GetNextRelevantCheckLightBatch(RelevantPairSlotBatch);
+
+	PipelineChecks.Reset();
+	for (const int32 PairSlot : RelevantPairSlotBatch)
+	{
+		const FLXRLightPair& LightPair = LightPairs[PairSlot];
+		if (!LightPair.LightSourceOwner.IsValid() || LightPair.LightSourceOwner == GetOwner())
+			continue;
+
+		FLXRPipelinedCheck& Check = PipelineChecks.AddDefaulted_GetRef();
+		Check.LightSourceOwner = LightPair.LightSourceOwner.Get();
+		Check.Result.PairSlot = PairSlot;
+	}
+
+	if (PipelineChecks.Num() == 0)
+		return;
+
+	const TConstArrayView<FVector> TraceTargets = Snapshot.GetTraceTargets(*Detector, true);
+	const float RequiredChecksToPass = TraceTargets.Num() * TracesRequired;
+	TArray<FLXRPipelinedCheck>* Checks = &PipelineChecks;
+	PipelineCullTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [&Snapshot, TraceTargets, RequiredChecksToPass, Checks]
+	{
+		SCOPE_CYCLE_COUNTER(STAT_RelevantCheck);
+		for (FLXRPipelinedCheck& Check : *Checks)
+		{
+			CullPipelinedCheck(Snapshot, TraceTargets, RequiredChecksToPass, Check);
+		}
+	});
+	LXRSubsystem->AddFrameSnapshotReader(PipelineCullTask);
+	INC_DWORD_STAT(STAT_THREADS);
+
+	PipelineStage = ELXRPipelineStage::Culling;
+}
+
+void ULXRDetectionComponent::CullPipelinedCheck(const FLXRFrameSnapshot& Snapshot, TConstArrayView<FVector> TraceTargets, float RequiredChecksToPass, FLXRPipelinedCheck& Check)
+{
+	FLXRRelevantCheckResult& Result = Check.Result;
+	Result.PassedComponents.Reset();
+	Result.bChecked = false;
+	Result.bPassed = false;
+
+	const int32* LightIndex = Snapshot.LightIndices.Find(Check.LightSourceOwner);
+	if (!LightIndex)
+		return;
+
+	const FLXRLightRecord& Light = Snapshot.Lights[*LightIndex];
+	if (Snapshot.bSoloFound && !Light.bSolo)
+		return;
+
+	//Disabled light stays relevant while it is in range, it can be enabled again.
+	const bool bInRange = LXRRelevancy::IsLightRelevant(Snapshot, Light, TraceTargets, RequiredChecksToPass, Result.PassedComponents);
+	Check.bRelevant = bInRange && Light.bEnabled;
+	if (!Check.bRelevant)
+		Result.PassedComponents.Reset();
+
+	Result.bAlwaysRelevant = Light.bAlwaysRelevant;
+	Result.bStillRelevant = bInRange;
+	Result.bChecked = true;
+}
+
+void ULXRDetectionComponent::SubmitPipelineTraces()
+{
+	FLXRTraceTargetArray TraceTargets;
+	GetTraceTargets(true, TraceTargets);
+
+	//Only Physics backend is traced asynchronously, other backends are cheap enough to answer right away.
+	const bool bAsyncPhysics = ResolvedVisibilityBackend == ELXRVisibilityBackend::Physics;
+	const ILXRVisibilityBackend& Backend = GetVisibilityBackend();
+
+	PipelineTraces.Reset();
+	PipelineTraceVisible.Reset();
+	PendingPipelineTraces = 0;
+	PipelineTraceFrame = GFrameCounter;
+	const double Now = GetWorld()->GetTimeSeconds();
+	for (FLXRPipelinedCheck& Check : PipelineChecks)
+	{
+		Check.FirstTrace = PipelineTraces.Num();
+		Check.NumTraces = 0;
+		Check.NumResolved = 0;
+		Check.ResolvedPassedChecks = 0;
+		Check.PendingRecords.Reset();
+		Check.TraceTime = Now;
+		Check.RequiredChecksToPass = TraceTargets.Num() * TracesRequired;
+		if (!Check.bRelevant || !IsPipelinedCheckCurrent(Check))
+			continue;
+
+		//Culling can finish on a frame other detection components already used up, rest of the batch is checked later.
+		if (!LXRSubsystem->HasTraceBudget())
+		{
+			Check.Result.bChecked = false;
+			DeferredRelevantLightBatch.Add(Check.Result.PairSlot);
+			continue;
+		}
+
+		const ULXRSourceComponent* LightSourceComponent = LightPairs[Check.Result.PairSlot].LightSourceComponent.Get();
+		if (!IsValid(LightSourceComponent))
+			continue;
+
+		//Trace start and end are taken from this frame, culling only decided which light components are traced.
+		const TArray<ULightComponent*>& LightComponents = LightSourceComponent->GetMyLightComponents();
+		const FCollisionQueryParams& QueryParams = GetVisibilityQueryParams(*LightSourceComponent->GetOwner());
+		FLXRVisibilityQuery Query;
+		Query.TraceChannel = TraceChannel;
+		Query.QueryParams = &QueryParams;
+		const TObjectKey<AActor> IgnoredOwners[] = {GetOwner(), LightSourceComponent->GetOwner()};
+		Query.IgnoredOwners = IgnoredOwners;
+		const FLXRVisibilityRecordArray* Records = GetVisibilityRecords(&LightPairs[Check.Result.PairSlot], LightComponents.Num(), TraceTargets.Num());
+		for (const int ComponentIndex : Check.Result.PassedComponents)
+		{
+			if (!LightComponents.IsValidIndex(ComponentIndex) || !IsValid(LightComponents[ComponentIndex]))
+				continue;
+
+			const ULightComponent& LightComponent = *LightComponents[ComponentIndex];
+			const bool bIsDirectionalLight = LightComponent.IsA(UDirectionalLightComponent::StaticClass());
+			const FLXRLightOcclusionMap* OcclusionMap = LightSourceComponent->GetOcclusionMap(ComponentIndex);
+			for (int i = 0; i < TraceTargets.Num(); ++i)
+			{
+				const FVector& TraceTarget = TraceTargets[i];
+				const FVector End = GetVisibilityTraceEnd(LightComponent, TraceTarget);
+				const int32 RecordIndex = ComponentIndex * TraceTargets.Num() + i;
+				bool bResolvedVisible;
+				if (ResolveVisibilityWithoutTrace(LightComponent, bIsDirectionalLight, LightSourceComponent, OcclusionMap, Records ? &(*Records)[RecordIndex] : NULL, TraceTarget, End, IgnoredOwners, Now, bResolvedVisible))
+				{
+					Check.NumResolved++;
+					Check.ResolvedPassedChecks += bResolvedVisible;
+					continue;
+				}
+
+				const uint32 TraceIndex = PipelineTraces.Num();
+				if (Records)
+					Check.PendingRecords.Add({RecordIndex, (int32)TraceIndex, TraceTarget, End});
+				if (bAsyncPhysics)
+				{
+					PipelineTraces.Add(GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Test, TraceTarget, End, TraceChannel, QueryParams, FCollisionResponseParams::DefaultResponseParam, &PipelineTraceDelegate, TraceIndex));
+					PipelineTraceVisible.Add(0);
+					PendingPipelineTraces++;
+				}
+				else
+				{
+					PipelineTraces.Add(FTraceHandle());
+					PipelineTraceVisible.Add(!Backend.IsBlocked(*GetWorld(), TraceTarget, End, Query));
+				}
+			}
+		}
+		Check.NumTraces = PipelineTraces.Num() - Check.FirstTrace;
+		LXRSubsystem->ConsumeTraceBudget(Check.NumTraces);
+	}
+
+	INC_DWORD_STAT_BY(STAT_TRACESMULTITHREAD, PendingPipelineTraces);
+
+	PipelineStage = ELXRPipelineStage::Tracing;
+	if (PendingPipelineTraces == 0)
+	{
+		ApplyPipelineResults(PipelineTraceVisible);
+		PipelineStage = ELXRPipelineStage::Idle;
+	}
+}
+
+void ULXRDetectionComponent::OnPipelineTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
+{
+	//Traces of a cancelled pipeline can still arrive.
+	if (PipelineStage != ELXRPipelineStage::Tracing || !PipelineTraces.IsValidIndex(TraceDatum.UserData) || PipelineTraces[TraceDatum.UserData] != TraceHandle)
+		return;
+
+	const bool bBlocked = TraceDatum.OutHits.ContainsByPredicate([](const FHitResult& Hit)
+	{
+		return Hit.bBlockingHit;
+	});
+	PipelineTraceVisible[TraceDatum.UserData] = !bBlocked;
+	PendingPipelineTraces--;
+}
+
+void ULXRDetectionComponent::ApplyPipelineResults(TConstArrayView<uint8> TraceVisible)
+{
+	for (FLXRPipelinedCheck& Check : PipelineChecks)
+	{
+		if (!Check.Result.bChecked || !IsPipelinedCheckCurrent(Check))
+			continue;
+
+		int PassedChecks = Check.ResolvedPassedChecks;
+		for (int32 i = Check.FirstTrace; i < Check.FirstTrace + Check.NumTraces; ++i)
+		{
+			if (TraceVisible[i])
+				PassedChecks++;
+		}
+
+		Check.Result.bPassed = Check.bRelevant && Check.NumTraces + Check.NumResolved > 0 && PassedChecks >= Check.RequiredChecksToPass;
+		ApplyPendingVisibilityRecords(Check, TraceVisible);
+		if (!Check.Result.bPassed)
+			Check.Result.PassedComponents.Reset();
+
+		ApplyRelevantCheckResult(Check.Result);
+	}
+	PipelineChecks.Reset();
+}
+
+void ULXRDetectionComponent::ResetRelevantCheckPipeline()
+{
+	if (PipelineStage == ELXRPipelineStage::Culling)
+		PipelineCullTask.Wait();
+
+	//Late traces of the discarded batch no longer match a handle in PipelineTraces and are ignored.
+	PipelineStage = ELXRPipelineStage::Idle;
+	PipelineChecks.Reset();
+	PipelineTraces.Reset();
+	PipelineTraceVisible.Reset();
+	PendingPipelineTraces = 0;
+}
+
+void ULXRDetectionComponent::CancelRelevantCheckPipeline()
+{
+	ResetRelevantCheckPipeline();
+	PipelineTraceDelegate.Unbind();
+}
+
+void ULXRDetectionComponent::QueueParallelRelevantChecks()
+{
+	//Previous batch is traced at end of frame by LXR subsystem.
+	if (bParallelChecksQueued)
+		return;
+
+	RelevantPairSlotBatch.Reset();
+	if (DeferredRelevantLightBatch.Num() > 0)
+		Swap(RelevantPairSlotBatch, DeferredRelevantLightBatch);
+	else
+		GetNextRelevantCheckLightBatch(RelevantPairSlotBatch);
+
+	FLXRTraceTargetArray TraceTargets;
+	GetTraceTargets(true, TraceTargets);
+	const float RequiredChecksToPass = TraceTargets.Num() * TracesRequired;
+
+	PipelineChecks.Reset();
+	int32 QueuedRays = 0;
+	const double Now = GetWorld()->GetTimeSeconds();
+	for (int i = 0; i < RelevantPairSlotBatch.Num(); ++i)
+	{
+		if (!LXRSubsystem->HasTraceBudget())
+		{
+			DeferredRelevantLightBatch.Append(&RelevantPairSlotBatch[i], RelevantPairSlotBatch.Num() - i);
+			break;
+		}
+
+		const int32 PairSlot = RelevantPairSlotBatch[i];
+		const FLXRLightPair& LightPair = LightPairs[PairSlot];
+		const ULXRSourceComponent* LightSourceComponent = LightPair.LightSourceComponent.Get();
+		if (!LightPair.LightSourceOwner.IsValid() || LightPair.LightSourceOwner == GetOwner() || !IsValid(LightSourceComponent))
+			continue;
+
+		if (LXRSubsystem->bSoloFound && !LightSourceComponent->bSolo)
+			continue;
+
+		FLXRPipelinedCheck& Check = PipelineChecks.AddDefaulted_GetRef();
+		Check.LightSourceOwner = LightPair.LightSourceOwner.Get();
+		Check.RequiredChecksToPass = RequiredChecksToPass;
+		FLXRRelevantCheckResult& Result = Check.Result;
+		Result.PairSlot = PairSlot;
+		Result.bAlwaysRelevant = LightSourceComponent->bAlwaysRelevant;
+		Result.bChecked = true;
+
+		FLXRIndexArray PassedTargets;
+		Check.bRelevant = LightSourceComponent->IsEnabled() && CheckIsLightRelevant(*LightSourceComponent, Result.PassedComponents, PassedTargets);
+		if (!Check.bRelevant)
+		{
+			Result.PassedComponents.Reset();
+			if (!Result.bAlwaysRelevant && LightPair.ConsecutiveFails + 1 > MaxConsecutiveFails)
+			{
+				FLXRIndexArray RelevancyPassedComponents;
+				FLXRIndexArray RelevancyPassedTargets;
+				Result.bStillRelevant = CheckIsLightRelevant(*LightSourceComponent, RelevancyPassedComponents, RelevancyPassedTargets);
+			}
+		}
+
+		Check.FirstTrace = LXRSubsystem->GetQueuedVisibilityRayCount();
+		if (Check.bRelevant)
+		{
+			const TArray<ULightComponent*>& LightComponents = LightSourceComponent->GetMyLightComponents();
+			FLXRVisibilityRay Ray;
+			Ray.TraceChannel = TraceChannel;
+			Ray.Backend = ResolvedVisibilityBackend;
+			Ray.IgnoredOwners[0] = GetOwner();
+			Ray.IgnoredOwners[1] = LightSourceComponent->GetOwner();
+			if (ResolvedVisibilityBackend == ELXRVisibilityBackend::Physics)
+				Ray.QueryParamsIndex = LXRSubsystem->AddVisibilityQueryParams(GetVisibilityQueryParams(*LightSourceComponent->GetOwner()));
+
+			const TObjectKey<AActor> IgnoredOwners[] = {GetOwner(), LightSourceComponent->GetOwner()};
+			const FLXRVisibilityRecordArray* Records = GetVisibilityRecords(&LightPairs[PairSlot], LightComponents.Num(), TraceTargets.Num());
+			Check.TraceTime = Now;
+			for (const int ComponentIndex : Result.PassedComponents)
+			{
+				const ULightComponent& LightComponent = *LightComponents[ComponentIndex];
+				const bool bIsDirectionalLight = LightComponent.IsA(UDirectionalLightComponent::StaticClass());
+				const FLXRLightOcclusionMap* OcclusionMap = LightSourceComponent->GetOcclusionMap(ComponentIndex);
+				for (int TargetIndex = 0; TargetIndex < TraceTargets.Num(); ++TargetIndex)
+				{
+					//Segments answered without a trace never join the shared batch.
+					Ray.Start = TraceTargets[TargetIndex];
+					Ray.End = GetVisibilityTraceEnd(LightComponent, Ray.Start);
+					const int32 RecordIndex = ComponentIndex * TraceTargets.Num() + TargetIndex;
+					bool bResolvedVisible;
+					if (ResolveVisibilityWithoutTrace(LightComponent, bIsDirectionalLight, LightSourceComponent, OcclusionMap, Records ? &(*Records)[RecordIndex] : NULL, Ray.Start, Ray.End, IgnoredOwners, Now, bResolvedVisible))
+					{
+						Check.NumResolved++;
+						Check.ResolvedPassedChecks += bResolvedVisible;
+						continue;
+					}
+
+					if (Records)
+						Check.PendingRecords.Add({RecordIndex, LXRSubsystem->GetQueuedVisibilityRayCount(), Ray.Start, Ray.End});
+					LXRSubsystem->QueueVisibilityRay(Ray);
+				}
+			}
+		}
+		Check.NumTraces = LXRSubsystem->GetQueuedVisibilityRayCount() - Check.FirstTrace;
+		QueuedRays += Check.NumTraces;
+		LXRSubsystem->ConsumeTraceBudget(Check.NumTraces);
+	}
+
+	if (PipelineChecks.Num() == 0)
+		return;
+
+	//Checks without rays are applied with the rest when subsystem scatters results back.
+	LXRSubsystem->RequestParallelVisibilityResults(this);
+	bParallelChecksQueued = true;
+}
+
+void ULXRDetectionComponent::ApplyParallelRelevantChecks(TConstArrayView<uint8> RayVisible)
+{
+	bParallelChecksQueued = false;
+	ApplyPipelineResults(RayVisible);
+}
+
+bool ULXRDetectionComponent::IsPipelinedCheckCurrent(const FLXRPipelinedCheck& Check) const
+{
+	return LightPairs.IsValidIndex(Check.Result.PairSlot) && TObjectKey<AActor>(LightPairs[Check.Result.PairSlot].LightSourceOwner.Get()) == Check.LightSourceOwner;
+}
+
+
+TArray<TWeakObjectPtr<AActor>>& ULXRDetectionComponent::GetLightArrayByLightArrayType(ELightArrayType LightArrayType)
+{
+	//All and Smart Far lights are not stored per component, see GetNextSharedLightBatch.
+	ensure(LightArrayType == ELightArrayType::SmartMid || LightArrayType == ELightArrayType::SmartNear);
+	if (LightArrayType == ELightArrayType::SmartMid)
+		return SmartMidLights;
+
+	return SmartNearLights;
+}
+
+void ULXRDetectionComponent::GetNextBatchByLightArrayType(TArray<TWeakObjectPtr<AActor>>& OutLightBatch, ELightArrayType LightArrayType)
+{
+	if (LightArrayType == ELightArrayType::All || LightArrayType == ELightArrayType::SmartFar)
+	{
+		int Index = GetCurrentLightArrayIndexByLightArrayType(LightArrayType);
+		GetNextSharedLightBatch(OutLightBatch, Index, RelevancyLightBatchCount, LightArrayType == ELightArrayType::SmartFar);
+		SetCurrentLightArrayIndexByLightArrayType(Index, LightArrayType);
+		return;
+	}
+
+	const bool bIsRelevancyCheck = LightArrayType < ELightArrayType::Relevant;
+	const int BatchCount = bIsRelevancyCheck ? RelevancyLightBatchCount : RelevantLightBatchCount;
+	TArray<TWeakObjectPtr<AActor>>& Array = GetLightArrayByLightArrayType(LightArrayType);
+	OutLightBatch.Reset();
+
+	int Index = GetCurrentLightArrayIndexByLightArrayType(LightArrayType);
+	// GEngine->AddOnScreenDebugMessage(1, GetWorld()->DeltaTimeSeconds, FColor::Red, FString::Printf(TEXT("Start")));
+	if (!Array.IsValidIndex(Index))
 		Index = Array.Num() - 1;
 
 	if (Array.Num() == 0)
@@ -1096,7 +1869,7 @@ void ULXRDetectionComponent::GetNextBatchByLightArrayType(TArray<TWeakObjectPtr<
 
 		if (!Array[Index].IsValid())
 		{
-			Array.RemoveAtSwap(Index);
+			Array.RemoveAtSwap(Index, 1, false);
 			Iteration++;
 			Index--;
 			continue;
@@ -1127,12 +1900,54 @@ void ULXRDetectionComponent::GetNextBatchByLightArrayType(TArray<TWeakObjectPtr<
 	SetCurrentLightArrayIndexByLightArrayType(Index, LightArrayType);
 }
 
-void ULXRDetectionComponent::GetNextRelevantCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& OutLightBatch)
+void ULXRDetectionComponent::GetNextSharedLightBatch(TArray<TWeakObjectPtr<AActor>>& OutLightBatch, int& Cursor, int BatchCount, bool bSkipTracked) const
 {
-	if (!RelevantLights.IsValidIndex(RelevantLightIndex))
-		RelevantLightIndex = RelevantLights.Num() - 1;
+	OutLightBatch.Reset();
 
-	if (RelevantLights.Num() == 0)
+	const TConstArrayView<TWeakObjectPtr<AActor>> AllLights = LXRSubsystem->GetAllLightsView();
+	if (AllLights.Num() == 0)
+	{
+		Cursor = -1;
+		return;
+	}
+
+	if (!AllLights.IsValidIndex(Cursor))
+		Cursor = AllLights.Num() - 1;
+
+	//At most one lap. Subsystem owns the list, so invalid lights are skipped instead of removed.
+	for (int Iteration = 0; Iteration < AllLights.Num() && OutLightBatch.Num() < BatchCount; ++Iteration)
+	{
+		const TWeakObjectPtr<AActor>& Light = AllLights[Cursor];
+		Cursor = Cursor == 0 ? AllLights.Num() - 1 : Cursor - 1;
+
+		if (!Light.IsValid() || LXRSubsystem->IsLightInLightGrid(Light.Get()))
+			continue;
+
+		if (bSkipTracked && IsSmartTrackedLight(Light))
+			continue;
+
+		if (LXRSubsystem->bSoloFound)
+		{
+			const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(Light->GetComponentByClass(ULXRSourceComponent::StaticClass()));
+			if (!IsValid(LightSourceComponent) || !LightSourceComponent->bSolo)
+				continue;
+		}
+
+		OutLightBatch.Add(Light);
+	}
+}
+
+bool ULXRDetectionComponent::IsSmartTrackedLight(const TWeakObjectPtr<AActor>& LightSourceOwner) const
+{
+	return SmartTrackedLights.Contains(LightSourceOwner);
+}
+
+void ULXRDetectionComponent::GetNextRelevantCheckLightBatch(TArray<int32>& OutPairSlotBatch)
+{
+	if (!RelevantLightSlots.IsValidIndex(RelevantLightIndex))
+		RelevantLightIndex = RelevantLightSlots.Num() - 1;
+
+	if (RelevantLightSlots.Num() == 0)
 	{
 		RelevantLightIndex = -1;
 		return;
@@ -1140,30 +1955,33 @@ void ULXRDetectionComponent::GetNextRelevantCheckLightBatch(TArray<TWeakObjectPt
 
 	for (RelevantLightIndex; RelevantLightIndex >= 0; --RelevantLightIndex)
 	{
-		if (!RelevantLights[RelevantLightIndex].IsValid())
+		const int32 PairSlot = RelevantLightSlots[RelevantLightIndex];
+		if (!LightPairs[PairSlot].LightSourceOwner.IsValid())
 		{
-			RelevantLights.RemoveAtSwap(RelevantLightIndex);
+			//Swaps last relevant slot in, which has already been visited on this pass.
+			RemoveLightPair(PairSlot);
 			continue;
 		}
 
-		if (RelevantLights[RelevantLightIndex] == GetOwner())
+		if (LightPairs[PairSlot].LightSourceOwner == GetOwner())
 			continue;
 
-		OutLightBatch.AddUnique(RelevantLights[RelevantLightIndex]);
-		if (OutLightBatch.Num() == RelevantLightBatchCount)
+		OutPairSlotBatch.AddUnique(PairSlot);
+		if (OutPairSlotBatch.Num() == RelevantLightBatchCount)
 			break;
 	}
 
 
-	if (OutLightBatch.Num() != RelevantLightBatchCount && RelevantLightIndex == -1 && RelevantLights.Num() < RelevantLightBatchCount)
+	if (OutPairSlotBatch.Num() != RelevantLightBatchCount && RelevantLightIndex == -1 && RelevantLightSlots.Num() < RelevantLightBatchCount)
 	{
-		for (RelevantLightIndex = RelevantLights.Num() - 1; RelevantLightIndex >= 0; --RelevantLightIndex)
+		for (RelevantLightIndex = RelevantLightSlots.Num() - 1; RelevantLightIndex >= 0; --RelevantLightIndex)
 		{
-			if (RelevantLights[RelevantLightIndex].IsValid())
+			const int32 PairSlot = RelevantLightSlots[RelevantLightIndex];
+			if (LightPairs[PairSlot].LightSourceOwner.IsValid())
 			{
-				OutLightBatch.AddUnique(RelevantLights[RelevantLightIndex]);
+				OutPairSlotBatch.AddUnique(PairSlot);
 				RelevantLightIndex--;
-				if (OutLightBatch.Num() == RelevantLightBatchCount)
+				if (OutPairSlotBatch.Num() == RelevantLightBatchCount)
 					break;
 			}
 		}
@@ -1173,19 +1991,21 @@ void ULXRDetectionComponent::GetNextRelevantCheckLightBatch(TArray<TWeakObjectPt
 
 bool ULXRDetectionComponent::CheckDirectionalLight(const ULightComponent& LightComponent, const FVector& Start) const
 {
+	bool bSunVisible;
+	if (LXRSubsystem->SampleSunVisibility(LightComponent, Start, bSunVisible))
+		return bSunVisible;
+
 	const FVector DirectionalForwardInverse = LightComponent.GetForwardVector() * -1;
 	const FVector End = Start + DirectionalForwardInverse.GetSafeNormal() * DirectionalLightTraceDistance;
 
-	TArray<AActor*> ActorsToIgnore;
-
-	ActorsToIgnore.Append(Cast<ULXRSourceComponent>(LightComponent.GetOwner()->GetComponentByClass(ULXRSourceComponent::StaticClass()))->GetMyOverlappingActors());
-	ActorsToIgnore.Append(Cast<ULXRSourceComponent>(LightComponent.GetOwner()->GetComponentByClass(ULXRSourceComponent::StaticClass()))->GetIgnoreVisibilityActors());
-	ActorsToIgnore.Append(IgnoreVisibilityActors);
+	FLXRVisibilityQuery Query;
+	Query.TraceChannel = TraceChannel;
+	Query.QueryParams = &GetVisibilityQueryParams(*LightComponent.GetOwner());
+	const TObjectKey<AActor> IgnoredOwners[] = {GetOwner(), LightComponent.GetOwner()};
+	Query.IgnoredOwners = IgnoredOwners;
 
-	ActorsToIgnore.AddUnique(GetOwner());
-	ActorsToIgnore.AddUnique(LightComponent.GetOwner());
-
-	if (!GetWorld()->LineTraceTestByChannel(Start, End, TraceChannel, GetCollisionQueryParams(ActorsToIgnore)))
+	LXRSubsystem->ConsumeTraceBudget(1);
+	if (!GetVisibilityBackend().IsBlocked(*GetWorld(), Start, End, Query))
 	{
 #if UE_ENABLE_DEBUG_DRAWING
 		if (bDrawDebug && Cast<ULXRSourceComponent>(LightComponent.GetOwner()->GetComponentByClass(ULXRSourceComponent::StaticClass()))->bDrawDebug)
@@ -1207,9 +2027,7 @@ bool ULXRDetectionComponent::CheckDistance(const ULXRSourceComponent& LightSourc
 	const FVector Start = GetOwner()->GetActorLocation();
 	const FVector End = LightSourceComponent.GetOwner()->GetActorLocation();
 
-	TArray<ULightComponent*> SourceLightComponents = LightSourceComponent.GetMyLightComponents();
-
-	for (ULightComponent* ItLightComponent : SourceLightComponents)
+	for (ULightComponent* ItLightComponent : LightSourceComponent.GetMyLightComponents())
 	{
 		const bool bIsSpotLight = ItLightComponent->IsA(USpotLightComponent::StaticClass());
 		const bool bIsPointLight = ItLightComponent->IsA(UPointLightComponent::StaticClass()) && !bIsSpotLight;
@@ -1230,23 +2048,14 @@ bool ULXRDetectionComponent::CheckDistance(const ULXRSourceComponent& LightSourc
 	const bool bIsPointLight = LightComponent.IsA(UPointLightComponent::StaticClass()) && !bIsSpotLight;
 	const float Attenuation = bIsSpotLight ? Cast<USpotLightComponent>(&LightComponent)->AttenuationRadius : bIsPointLight ? Cast<UPointLightComponent>(&LightComponent)->AttenuationRadius : Cast<URectLightComponent>(&LightComponent)->AttenuationRadius;
 
-	const float DistanceToCheck = Attenuation * LightSourceComponent.AttenuationMultiplierToBeRelevant;
-	const float DistanceSqr = FVector::DistSquared(Start, End);
-
-	if (DistanceSqr < DistanceToCheck * DistanceToCheck)
-		return true;
-	return false;
+	return LXRRelevancy::IsInsideRadius(Start, End, Attenuation * LightSourceComponent.AttenuationMultiplierToBeRelevant);
 }
 
 
-void ULXRDetectionComponent::GetLightSystemLights()
-{
-	AllLights = LXRSubsystem->GetAllLights();
-}
-
 void ULXRDetectionComponent::AddLight(AActor* LightSource)
 {
-	if (LXRSubsystem)
+	//Only Smart needs to know, new near lights are tracked right away instead of waiting for Far check.
+	if (LXRSubsystem && RelevancyCheckType == ERelevancyCheckType::Smart)
 		NewAllLightsToAdd.AddUnique(LightSource);
 }
 
@@ -1255,19 +2064,111 @@ void ULXRDetectionComponent::RemoveLight(AActor* LightSource)
 	LightsToRemove.AddUnique(LightSource);
 }
 
+void ULXRDetectionComponent::AddLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSources)
+{
+	//Subsystem batches are free of duplicates, appended without a per light search.
+	if (LXRSubsystem && RelevancyCheckType == ERelevancyCheckType::Smart)
+		NewAllLightsToAdd.Append(LightSources.GetData(), LightSources.Num());
+
+	if (bDormant && DoLightsAffectDormancy(LightSources, true))
+		WakeUp();
+}
+
+void ULXRDetectionComponent::RemoveLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSources)
+{
+	LightsToRemove.Append(LightSources.GetData(), LightSources.Num());
+
+	if (bDormant && DoLightsAffectDormancy(LightSources, false))
+		WakeUp();
+}
+
+bool ULXRDetectionComponent::DoLightsAffectDormancy(TConstArrayView<TWeakObjectPtr<AActor>> LightSources, bool bAdded) const
+{
+	const FVector Start = GetOwner()->GetActorLocation();
+	for (const TWeakObjectPtr<AActor>& LightSource : LightSources)
+	{
+		if (!LightSource.IsValid())
+			continue;
+
+		//Destroyed relevant lights change relevant lights hash, only unregistered live ones need a lookup.
+		if (!bAdded)
+		{
+			if (FindLightPairSlot(LightSource.Get()) != INDEX_NONE)
+				return true;
+			continue;
+		}
+
+		const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSource->GetComponentByClass(ULXRSourceComponent::StaticClass()));
+		if (!IsValid(LightSourceComponent))
+			continue;
+
+		const FVector End = LightSource->GetActorLocation();
+		for (const ULightComponent* LightComponent : LightSourceComponent->GetMyLightComponents())
+		{
+			if (!IsValid(LightComponent) || LightComponent->IsA(UDirectionalLightComponent::StaticClass()))
+				return true;
+
+			const ULocalLightComponent* LocalLightComponent = Cast<ULocalLightComponent>(LightComponent);
+			if (LocalLightComponent && LXRRelevancy::IsInsideRadius(Start, End, LocalLightComponent->AttenuationRadius * LightSourceComponent->AttenuationMultiplierToBeRelevant))
+				return true;
+		}
+	}
+	return false;
+}
+
 bool ULXRDetectionComponent::GetIsRelevant(const ULXRSourceComponent& LightSourceComponent) const
 {
-	return RelevantLights.Contains(LightSourceComponent.GetOwner());
+	return FindLightPairSlot(LightSourceComponent.GetOwner()) != INDEX_NONE;
 }
 
+int32 ULXRDetectionComponent::FindLightPairSlot(const AActor* LightSourceOwner) const
+{
+	//Only relevancy checks and light events look pairs up by actor, relevant checks carry slots.
+	const int32* PairSlot = LightPairSlotsByOwner.Find(LightSourceOwner);
+	return PairSlot ? *PairSlot : INDEX_NONE;
+}
+
+int32 ULXRDetectionComponent::AddLightPair(const TWeakObjectPtr<AActor>& LightSourceOwner)
+{
+	FLXRLightPair LightPair;
+	LightPair.LightSourceOwner = LightSourceOwner;
+	LightPair.LightSourceOwnerKey = LightSourceOwner.Get();
+	LightPair.LightSourceComponent = Cast<ULXRSourceComponent>(LightSourceOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()));
+
+	const int32 PairSlot = LightPairs.Add(MoveTemp(LightPair));
+	LightPairs[PairSlot].RelevantIndex = RelevantLightSlots.Add(PairSlot);
+	LightPairSlotsByOwner.Add(LightPairs[PairSlot].LightSourceOwnerKey, PairSlot);
+	SmartTrackedLights.Add(LightSourceOwner, ELightArrayType::Relevant);
+	return PairSlot;
+}
 
-bool ULXRDetectionComponent::CheckIsLightRelevant(const ULXRSourceComponent& LightSourceComponent, TArray<int>& PassedComponents, TArray<int>& PassedTargets, bool IsLightSenseCheck, bool IsFromThread) const
+void ULXRDetectionComponent::RemoveLightPair(int32 PairSlot)
+{
+	RemovePassedLight(PairSlot);
+
+	const int32 RelevantIndex = LightPairs[PairSlot].RelevantIndex;
+	RelevantLightSlots.RemoveAtSwap(RelevantIndex, 1, false);
+	if (RelevantLightSlots.IsValidIndex(RelevantIndex))
+		LightPairs[RelevantLightSlots[RelevantIndex]].RelevantIndex = RelevantIndex;
+
+	//Smart light leaving relevant lights has already been queued back to its Smart array.
+	const ELightArrayType* TrackedArrayType = SmartTrackedLights.Find(LightPairs[PairSlot].LightSourceOwner);
+	if (TrackedArrayType && *TrackedArrayType == ELightArrayType::Relevant)
+		SmartTrackedLights.Remove(LightPairs[PairSlot].LightSourceOwner);
+
+	LightPairSlotsByOwner.Remove(LightPairs[PairSlot].LightSourceOwnerKey);
+	LightPairs.RemoveAt(PairSlot);
+}
+
+
+bool ULXRDetectionComponent::CheckIsLightRelevant(const ULXRSourceComponent& LightSourceComponent, FLXRIndexArray& PassedComponents, FLXRIndexArray& PassedTargets, bool IsLightSenseCheck, bool IsFromThread) const
 {
 	const bool bIsRelevantCheck = GetIsRelevant(LightSourceComponent);
 
-	TArray<FVector> TraceTargets = GetTraceTargets(bIsRelevantCheck);
+	FLXRTraceTargetArray TraceTargets;
+	GetTraceTargets(bIsRelevantCheck, TraceTargets);
 
-	TArray<ULightComponent*> LightComponents = LightSourceComponent.GetMyLightComponents();
+	const TArray<ULightComponent*>& LightComponents = LightSourceComponent.GetMyLightComponents();
 
 	int PassedChecks = 0;
 	int ComponentIdx = 0;
@@ -1470,50 +2371,95 @@ bool ULXRDetectionComponent::CheckIsLightRelevant(const ULXRSourceComponent& Lig
 	}
 
 	if (!Passed)
-		PassedComponents.Empty();
+		PassedComponents.Reset();
 
 	return Passed;
 }
 
-bool ULXRDetectionComponent::CheckVisibility(const TArray<ULightComponent*>& LightComponents, const TArray<int>& PassedComponents, TArray<int>& PassedTargets, bool IsLightSenseCheck)
+bool ULXRDetectionComponent::CheckVisibility(const TArray<ULightComponent*>& LightComponents, const FLXRIndexArray& PassedComponents, FLXRIndexArray& PassedTargets, FLXRLightPair* LightPair, bool IsLightSenseCheck)
 {
-	TArray<FVector> TraceTargets;
-	TraceTargets = GetTraceTargets(true);
+	FLXRTraceTargetArray TraceTargets;
+	GetTraceTargets(true, TraceTargets);
 
 	int PassedChecks = 0;
 	const float RequiredChecksToPassAmount = TraceTargets.Num() * TracesRequired;
 
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	FLXRVisibilityRecordArray* Records = GetVisibilityRecords(LightPair, LightComponents.Num(), TraceTargets.Num());
+
+	const FCollisionQueryParams* QueryParams = NULL;
+	const ILXRVisibilityBackend& Backend = GetVisibilityBackend();
+	const ULXRSourceComponent* LightSourceComponent = LightPair ? LightPair->LightSourceComponent.Get() : NULL;
+	FLXRTraceTargetArray TraceStarts;
+	FLXRTraceTargetArray TraceEnds;
+	FLXRIndexArray TracedTargets;
+	FLXRBlockedBitArray Blocked;
 	for (const auto ComponentIndex : PassedComponents)
 	{
 		const ULightComponent* LightComponent = LightComponents[ComponentIndex];
+		const FLXRLightOcclusionMap* OcclusionMap = LightSourceComponent ? LightSourceComponent->GetOcclusionMap(ComponentIndex) : NULL;
+		const bool bIsDirectionalLight = LightComponent->IsA(UDirectionalLightComponent::StaticClass());
 
+		//Same owners are ignored by occluder checks over occlusion maps and by the backend.
+		const TObjectKey<AActor> IgnoredOwners[] = {GetOwner(), LightComponent->GetOwner()};
+
+		//Targets without a reusable visibility record go to the backend together, packet backends test them in one go.
+		TraceStarts.Reset();
+		TraceEnds.Reset();
+		TracedTargets.Reset();
 		for (int i = 0; i < TraceTargets.Num(); ++i)
 		{
-			const int ThisLoopPassedChecks = PassedChecks;
-			FVector TraceTarget = TraceTargets[i];
-			FVector Start = TraceTarget;
-			FVector End;
-			TArray<AActor*> ActorsToIgnore;
-			ActorsToIgnore.Append(Cast<ULXRSourceComponent>(LightComponent->GetOwner()->GetComponentByClass(ULXRSourceComponent::StaticClass()))->GetMyOverlappingActors());
-			ActorsToIgnore.Append(Cast<ULXRSourceComponent>(LightComponent->GetOwner()->GetComponentByClass(ULXRSourceComponent::StaticClass()))->GetIgnoreVisibilityActors());
-			ActorsToIgnore.Append(IgnoreVisibilityActors);
-
-			ActorsToIgnore.AddUnique(GetOwner());
-			ActorsToIgnore.AddUnique(LightComponent->GetOwner());
-
-			INC_DWORD_STAT(STAT_TRACESSYNC);
-			if (LightComponent->IsA(UDirectionalLightComponent::StaticClass()))
+			const FVector Start = TraceTargets[i];
+			const FVector End = GetVisibilityTraceEnd(*LightComponent, Start);
+
+			const FLXRVisibilityRecord* Record = Records ? &(*Records)[ComponentIndex * TraceTargets.Num() + i] : NULL;
+			bool bResolvedVisible;
+			if (ResolveVisibilityWithoutTrace(*LightComponent, bIsDirectionalLight, LightSourceComponent, OcclusionMap, Record, Start, End, IgnoredOwners, Now, bResolvedVisible))
 			{
-				FVector DirectionalForwardInverse = LightComponent->GetForwardVector() * -1;
-				End = Start + DirectionalForwardInverse.GetSafeNormal() * 15000;
+				if (bResolvedVisible)
+					PassedChecks++;
+				continue;
 			}
-			else
+
+			TraceStarts.Add(Start);
+			TraceEnds.Add(End);
+			TracedTargets.Add(i);
+		}
+
+		if (TracedTargets.Num() == 0)
+			continue;
+
+		//All light components belong to the same light source, ignored actors are gathered once.
+		if (!QueryParams)
+			QueryParams = &GetVisibilityQueryParams(*LightComponent->GetOwner());
+
+		FLXRVisibilityQuery Query;
+		Query.TraceChannel = TraceChannel;
+		Query.QueryParams = QueryParams;
+		Query.IgnoredOwners = IgnoredOwners;
+
+		INC_DWORD_STAT_BY(STAT_TRACESSYNC, TracedTargets.Num());
+		LXRSubsystem->ConsumeTraceBudget(TracedTargets.Num());
+		Backend.GetBlockedSegments(*GetWorld(), TraceStarts, TraceEnds, Query, Blocked);
+
+		for (int TracedIndex = 0; TracedIndex < TracedTargets.Num(); ++TracedIndex)
+		{
+			const int ThisLoopPassedChecks = PassedChecks;
+			const FVector& Start = TraceStarts[TracedIndex];
+			const FVector& End = TraceEnds[TracedIndex];
+			const bool bVisible = !Blocked[TracedIndex];
+
+			FLXRVisibilityRecord* Record = Records ? &(*Records)[ComponentIndex * TraceTargets.Num() + TracedTargets[TracedIndex]] : NULL;
+			if (Record)
 			{
-				End = LightComponent->GetComponentLocation();
+				Record->Start = Start;
+				Record->End = End;
+				Record->Time = Now;
+				Record->bVisible = bVisible;
 			}
 
-			FCollisionQueryParams P = GetCollisionQueryParams(ActorsToIgnore);
-			if (!GetWorld()->LineTraceTestByChannel(Start, End, TraceChannel, P))
+			if (bVisible)
 			{
 				PassedChecks++;
 			}
@@ -1525,7 +2471,7 @@ bool ULXRDetectionComponent::CheckVisibility(const TArray<ULightComponent*>& Lig
 				DrawDebugSphere(GetWorld(), LightComponent->GetComponentLocation(), 15, 12, FColor::Green, false, DebugDrawTime);
 
 				FHitResult result;
-				if (GetWorld()->LineTraceSingleByChannel(result, Start, End, TraceChannel, P))
+				if (GetWorld()->LineTraceSingleByChannel(result, Start, End, TraceChannel, *QueryParams))
 				{
 					DrawDebugBox(GetWorld(), result.Location, FVector(10), FColor::Red, false, DebugDrawTime, 0, 2);
 					if (bPrintDebug)
@@ -1549,6 +2495,93 @@ bool ULXRDetectionComponent::CheckVisibility(const TArray<ULightComponent*>& Lig
 	return PassedChecks >= RequiredChecksToPassAmount;
 }
 
+FVector ULXRDetectionComponent::GetVisibilityTraceEnd(const ULightComponent& LightComponent, const FVector& Start) const
+{
+	if (LightComponent.IsA(UDirectionalLightComponent::StaticClass()))
+	{
+		const FVector DirectionalForwardInverse = LightComponent.GetForwardVector() * -1;
+		return Start + DirectionalForwardInverse.GetSafeNormal() * DirectionalLightTraceDistance;
+	}
+
+	return LightComponent.GetComponentLocation();
+}
+
+const ILXRVisibilityBackend& ULXRDetectionComponent::GetVisibilityBackend() const
+{
+	return LXRSubsystem->GetVisibilityBackend(ResolvedVisibilityBackend);
+}
+
+FLXRVisibilityRecordArray* ULXRDetectionComponent::GetVisibilityRecords(FLXRLightPair* LightPair, int32 NumLightComponents, int32 NumTraceTargets) const
+{
+	if (!bUseVisibilityCache || !LightPair)
+		return NULL;
+
+	FLXRVisibilityRecordArray& Records = LightPair->VisibilityRecords;
+	if (Records.Num() != NumLightComponents * NumTraceTargets)
+	{
+		Records.Reset();
+		Records.SetNum(NumLightComponents * NumTraceTargets);
+	}
+	return &Records;
+}
+
+bool ULXRDetectionComponent::ResolveVisibilityWithoutTrace(const ULightComponent& LightComponent, bool bIsDirectionalLight, const ULXRSourceComponent* LightSourceComponent, const FLXRLightOcclusionMap* OcclusionMap,
+                                                           const FLXRVisibilityRecord* Record, const FVector& Start, const FVector& End, TConstArrayView<TObjectKey<AActor>> IgnoredOwners, double Now, bool& bOutVisible) const
+{
+	if (Record && CanReuseVisibilityRecord(*Record, Start, End, Now))
+	{
+		INC_DWORD_STAT(STAT_VISIBILITYCACHEHITS);
+		bOutVisible = Record->bVisible;
+		return true;
+	}
+
+	if (bIsDirectionalLight && LXRSubsystem->SampleSunVisibility(LightComponent, Start, bOutVisible))
+		return true;
+
+	//Map only knows static geometry, segment crossing a LXR Occluder is traced normally.
+	if (OcclusionMap && OcclusionMap->Sample(Start, LightSourceComponent->OcclusionMapDepthBias, bOutVisible)
+		&& !(bOutVisible && LightSourceComponent->bTraceOccludersOverOcclusionMaps && LXRSubsystem->GetOcclusionBVH().IsBlocked(Start, End, IgnoredOwners)))
+	{
+		INC_DWORD_STAT(STAT_OCCLUSIONMAPSAMPLES);
+		return true;
+	}
+
+	return false;
+}
+
+void ULXRDetectionComponent::ApplyPendingVisibilityRecords(const FLXRPipelinedCheck& Check, TConstArrayView<uint8> TraceVisible)
+{
+	if (Check.PendingRecords.Num() == 0)
+		return;
+
+	FLXRVisibilityRecordArray& Records = LightPairs[Check.Result.PairSlot].VisibilityRecords;
+	for (const FLXRPendingVisibilityRecord& PendingRecord : Check.PendingRecords)
+	{
+		//Light components or trace targets changed while the check was in flight.
+		if (!Records.IsValidIndex(PendingRecord.RecordIndex))
+			continue;
+
+		FLXRVisibilityRecord& Record = Records[PendingRecord.RecordIndex];
+		Record.Start = PendingRecord.Start;
+		Record.End = PendingRecord.End;
+		Record.Time = Check.TraceTime;
+		Record.bVisible = TraceVisible[PendingRecord.Trace] != 0;
+	}
+}
+
+bool ULXRDetectionComponent::CanReuseVisibilityRecord(const FLXRVisibilityRecord& Record, const FVector& Start, const FVector& End, double Now) const
+{
+	if (Record.Time < 0 || Now - Record.Time > VisibilityCacheMaxAge)
+		return false;
+
+	const float ThresholdSqr = VisibilityCacheMovementThreshold * VisibilityCacheMovementThreshold;
+	if (FVector::DistSquared(Record.Start, Start) > ThresholdSqr || FVector::DistSquared(Record.End, End) > ThresholdSqr)
+		return false;
+
+	//Random revalidation catches dynamic occluders moving between unchanged endpoints.
+	return FMath::FRand() >= VisibilityCacheRevalidationChance;
+}
+
 ULXRSourceComponent* ULXRDetectionComponent::GetCurrentLightSourceComponentByType(const ELightArrayType LightArrayType) const
 {
 	const int Index = GetCurrentLightArrayIndexByLightArrayType(LightArrayType);
@@ -1580,21 +2613,17 @@ ULXRSourceComponent* ULXRDetectionComponent::GetLightSourceComponentByTypeAndInd
 	switch (LightArrayType)
 	{
 		case ELightArrayType::All:
+		case ELightArrayType::SmartFar:
 			{
+				const TConstArrayView<TWeakObjectPtr<AActor>> AllLights = LXRSubsystem->GetAllLightsView();
 				if (AllLights.IsValidIndex(Index))
 					LightSource = AllLights[Index].Get();
 			}
 			break;
 		case ELightArrayType::Relevant:
 			{
-				if (RelevantLights.IsValidIndex(Index))
-					LightSource = RelevantLights[Index].Get();
-			}
-			break;
-		case ELightArrayType::SmartFar:
-			{
-				if (SmartFarLights.IsValidIndex(Index))
-					LightSource = SmartFarLights[Index].Get();
+				if (RelevantLightSlots.IsValidIndex(Index))
+					LightSource = LightPairs[RelevantLightSlots[Index]].LightSourceOwner.Get();
 			}
 			break;
 		case ELightArrayType::SmartMid:
@@ -1622,69 +2651,44 @@ ULXRSourceComponent* ULXRDetectionComponent::GetLightSourceComponentByTypeAndInd
 	return LightSourceComponent;
 }
 
-void ULXRDetectionComponent::IncreaseFailCount(const TWeakObjectPtr<AActor>& LightSourceOwner)
+void ULXRDetectionComponent::IncreaseFailCount(int32 PairSlot)
 {
-	RemovePassedLight(LightSourceOwner);
-	if (!RelevantLightsFailCounts.Contains(LightSourceOwner))
-		RelevantLightsFailCounts.Add(LightSourceOwner, 0);
-
-	int Fails = RelevantLightsFailCounts[LightSourceOwner];
-	Fails++;
-	RelevantLightsFailCounts[LightSourceOwner] = Fails;
+	RemovePassedLight(PairSlot);
+	LightPairs[PairSlot].ConsecutiveFails++;
 }
 
-void ULXRDetectionComponent::IncreaseFailCountIfNotAlwaysRelevantLightFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner)
+void ULXRDetectionComponent::RemoveNotRelevantLight(int32 PairSlot)
 {
-	FRWScopeLock RelevantLightLock(RelevantDataLockObject, SLT_Write);
-	IncreaseFailCount(LightSourceOwner);
-}
+	const TWeakObjectPtr<AActor> LightSourceOwner = LightPairs[PairSlot].LightSourceOwner;
+	if (!LightSourceOwner.IsValid())
+		return;
 
-void ULXRDetectionComponent::CheckAndRemoveIfLightNotRelevant(const TWeakObjectPtr<AActor>& LightSourceOwner, bool IsFromThread)
-{
-	const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSourceOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()));
-	TArray<int> PassedComponents;
-	TArray<int> PassedTargets;
-	if (!CheckIsLightRelevant(*LightSourceComponent, PassedComponents, PassedTargets, false, IsFromThread))
-	{
-		RelevantLightsToRemove.AddUnique(LightSourceOwner);
-		RelevantLightsFailCounts.Remove(LightSourceOwner);
+	RelevantLightsToRemove.AddUnique(LightSourceOwner);
+	LightPairs[PairSlot].ConsecutiveFails = 0;
 
-		if (RelevancyCheckType == ERelevancyCheckType::Smart)
-		{
-			const ELightArrayType SmartArrayType = GetSmartArrayTypeForLightFromSqrDistance(FVector::DistSquared(LightSourceOwner.Get()->GetActorLocation(), GetOwner()->GetActorLocation()));
-			AddToSmartArrayBySmartArrayType(SmartArrayType, *LightSourceOwner);
-		}
+	//Grid lights are found by cell lookup again, they never go to Smart arrays.
+	if (RelevancyCheckType == ERelevancyCheckType::Smart && !LXRSubsystem->IsLightInLightGrid(LightSourceOwner.Get()))
+	{
+		const ELightArrayType SmartArrayType = GetSmartArrayTypeForLightFromSqrDistance(FVector::DistSquared(LightSourceOwner.Get()->GetActorLocation(), GetOwner()->GetActorLocation()));
+		AddToSmartArrayBySmartArrayType(SmartArrayType, *LightSourceOwner);
 	}
 }
 
-void ULXRDetectionComponent::CheckAndRemoveIfLightNotRelevantFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner)
-{
-	FRWScopeLock RelevantLightLock(RelevantDataLockObject, SLT_Write);
-	CheckAndRemoveIfLightNotRelevant(LightSourceOwner, true);
-}
-
 
 void ULXRDetectionComponent::AddNewLights()
 {
 	for (TWeakObjectPtr<AActor> NewLight : NewAllLightsToAdd)
 	{
-		if (NewLight.IsValid())
+		if (NewLight.IsValid() && !LXRSubsystem->IsLightInLightGrid(NewLight.Get()))
 		{
 			if (RelevancyCheckType == ERelevancyCheckType::Smart)
 			{
 				const float DistSqr = FVector::DistSquared(NewLight.Get()->GetActorLocation(), GetOwner()->GetActorLocation());
-				if (DistSqr > RelevancySmartDistanceMax * RelevancySmartDistanceMax)
-					SmartFarLights.AddUnique(NewLight);
-				if (DistSqr > RelevancySmartDistanceMin * RelevancySmartDistanceMin && DistSqr < RelevancySmartDistanceMax * RelevancySmartDistanceMax)
-					SmartMidLights.AddUnique(NewLight);
-				if (DistSqr < RelevancySmartDistanceMin * RelevancySmartDistanceMin)
-					SmartNearLights.AddUnique(NewLight);
+				AddToSmartArrayBySmartArrayType(GetSmartArrayTypeForLightFromSqrDistance(DistSqr), *NewLight);
 			}
-
-			AllLights.AddUnique(NewLight);
 		}
 	}
-	NewAllLightsToAdd.Empty();
+	NewAllLightsToAdd.Reset();
 }
 
 
@@ -1692,24 +2696,23 @@ void ULXRDetectionComponent::RemoveNonRelevantLights()
 {
 	for (TWeakObjectPtr<AActor> LightToRemove : RelevantLightsToRemove)
 	{
-		if (RelevantLights.Contains(LightToRemove))
-			RelevantLights.RemoveSwap(LightToRemove);
-
-		RemovePassedLight(LightToRemove);
+		const int32 PairSlot = FindLightPairSlot(LightToRemove.Get());
+		if (PairSlot != INDEX_NONE)
+			RemoveLightPair(PairSlot);
 	}
 
-	RelevantLightsToRemove.Empty();
+	RelevantLightsToRemove.Reset();
 }
 
 void ULXRDetectionComponent::AddNewRelevantLights()
 {
 	for (TWeakObjectPtr<AActor> LightToAdd : NewRelevantLightsToAdd)
 	{
-		if (!RelevantLights.Contains(LightToAdd))
-			RelevantLights.AddUnique(LightToAdd);
+		if (LightToAdd.IsValid() && FindLightPairSlot(LightToAdd.Get()) == INDEX_NONE)
+			AddLightPair(LightToAdd);
 	}
 
-	NewRelevantLightsToAdd.Empty();
+	NewRelevantLightsToAdd.Reset();
 }
 
 void ULXRDetectionComponent::RemoveRedundantLights()
@@ -1718,16 +2721,15 @@ void ULXRDetectionComponent::RemoveRedundantLights()
 	{
 		if (RedundantLight.IsStale() || RedundantLight.IsValid())
 		{
-			if (AllLights.Contains(RedundantLight))
-				AllLights.RemoveSwap(RedundantLight);
-			if (RelevantLights.Contains(RedundantLight))
+			if (FindLightPairSlot(RedundantLight.Get()) != INDEX_NONE)
 				RelevantLightsToRemove.AddUnique(RedundantLight);
-			if (SmartNearLights.Contains(RedundantLight))
+			if (SmartTrackedLights.Remove(RedundantLight) > 0)
+			{
 				SmartNearLights.RemoveSwap(RedundantLight);
-			if (SmartMidLights.Contains(RedundantLight))
 				SmartMidLights.RemoveSwap(RedundantLight);
-			if (SmartFarLights.Contains(RedundantLight))
-				SmartFarLights.RemoveSwap(RedundantLight);
+			}
+			SmartNearLightsToAdd.RemoveSwap(RedundantLight);
+			SmartMidLightsToAdd.RemoveSwap(RedundantLight);
 		}
 		// else
 		// {
@@ -1738,16 +2740,13 @@ void ULXRDetectionComponent::RemoveRedundantLights()
 		// }
 	}
 
-	LightsToRemove.Empty();
+	LightsToRemove.Reset();
 }
 
 void ULXRDetectionComponent::RemoveAllStaleLights()
 {
-	RemoveStaleLightsByLightArrayType(ELightArrayType::All);
-	RemoveStaleLightsByLightArrayType(ELightArrayType::SmartFar);
 	RemoveStaleLightsByLightArrayType(ELightArrayType::SmartMid);
 	RemoveStaleLightsByLightArrayType(ELightArrayType::SmartNear);
-	RemoveStaleLightsByLightArrayType(ELightArrayType::Relevant);
 }
 
 void ULXRDetectionComponent::RemoveStaleLightsByLightArrayType(ELightArrayType LightArrayType)
@@ -1782,64 +2781,67 @@ void ULXRDetectionComponent::RemoveStaleLightsByLightArrayType(ELightArrayType L
 	}
 }
 
-void ULXRDetectionComponent::RemovePassedLight(const TWeakObjectPtr<AActor>& LightSourceOwner)
+void ULXRDetectionComponent::RemovePassedLight(int32 PairSlot)
 {
-	const int Index = RelevantLightsPassed.Find(LightSourceOwner);
-	if (Index != INDEX_NONE)
+	FLXRLightPair& LightPair = LightPairs[PairSlot];
+	const int32 PassedIndex = LightPair.PassedIndex;
+	if (PassedIndex != INDEX_NONE)
 	{
-		RelevantLightsPassed.RemoveAtSwap(Index);
-		if (LightSourceOwner.IsValid())
+		PassedLightSlots.RemoveAtSwap(PassedIndex, 1, false);
+		if (PassedLightSlots.IsValidIndex(PassedIndex))
+			LightPairs[PassedLightSlots[PassedIndex]].PassedIndex = PassedIndex;
+
+		LightPair.PassedIndex = INDEX_NONE;
+		LightPair.PassedComponents.Reset();
+
+		ULXRSourceComponent* LxrSourceComponent = LightPair.LightSourceComponent.Get();
+		if (IsValid(LxrSourceComponent))
 		{
-			ULXRSourceComponent* LxrSourceComponent = Cast<ULXRSourceComponent>(LightSourceOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()));
 			if (LxrSourceComponent->bAddDetected && bAddToSourceWhenDetected)
-				LxrSourceComponent->DetectedActors.RemoveSwap(GetOwner());
+				LxrSourceComponent->RemoveDetectedActor(GetOwner());
 
-			// OnLightCheckChanged.Broadcast(RelevantLightsPassed.Num(), LxrSourceComponent);
+			// OnLightCheckChanged.Broadcast(PassedLightSlots.Num(), LxrSourceComponent);
 		}
 	}
 }
 
-void ULXRDetectionComponent::LightPassed(const TWeakObjectPtr<AActor>& LightSourceOwner, const TArray<int>& PassedComponents)
+void ULXRDetectionComponent::LightPassed(int32 PairSlot, const FLXRIndexArray& PassedComponents)
 {
-	// FRWScopeLock RelevantLightLock(RelevantDataLockObject, SLT_Write);
-	const int Index = RelevantLightsPassed.Find(LightSourceOwner);
-	ULXRSourceComponent* LxrSourceComponent = Cast<ULXRSourceComponent>(LightSourceOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()));
-	if (Index == INDEX_NONE)
+	FLXRLightPair& LightPair = LightPairs[PairSlot];
+	if (LightPair.PassedIndex == INDEX_NONE)
 	{
-		RelevantLightsPassed.Add(LightSourceOwner);
-		if (LxrSourceComponent->bAddDetected && bAddToSourceWhenDetected)
-			LxrSourceComponent->DetectedActors.AddUnique(GetOwner());
-		// OnLightCheckChanged.Broadcast(RelevantLightsPassed.Num(), LxrSourceComponent);
+		LightPair.PassedIndex = PassedLightSlots.Add(PairSlot);
+		ULXRSourceComponent* LxrSourceComponent = LightPair.LightSourceComponent.Get();
+		if (IsValid(LxrSourceComponent) && LxrSourceComponent->bAddDetected && bAddToSourceWhenDetected)
+			LxrSourceComponent->AddDetectedActor(GetOwner());
+		// OnLightCheckChanged.Broadcast(PassedLightSlots.Num(), LxrSourceComponent);
 	}
 
-	if (!LightsPassedComponents.Contains(LightSourceOwner))
-		LightsPassedComponents.Add(LightSourceOwner);
-
-	LightsPassedComponents[LightSourceOwner] = PassedComponents;
-	// LightsPassedComponents.Add(LxrSourceComponent,PassedComponents);
-	// LxrSourceComponent->AddPassedComponentIndexes(PassedComponents);
-
-	if (RelevantLightsFailCounts.Contains(LightSourceOwner))
-		RelevantLightsFailCounts.Remove(LightSourceOwner);
-}
+	LightPair.PassedComponents.Reset();
+	for (const int ComponentIndex : PassedComponents)
+	{
+		if (ComponentIndex >= LightPair.PassedComponents.Num())
+			LightPair.PassedComponents.SetNum(ComponentIndex + 1, false);
+		LightPair.PassedComponents[ComponentIndex] = true;
+	}
 
-void ULXRDetectionComponent::LightPassedFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner, const TArray<int>& PassedComponents)
-{
-	FRWScopeLock RelevantLightLock(RelevantDataLockObject, SLT_Write);
-	LightPassed(LightSourceOwner, PassedComponents);
+	LightPair.ConsecutiveFails = 0;
 }
 
 TArray<FVector> ULXRDetectionComponent::GetRelevantTraceTypeTargets() const
 {
-	return GetTraceTargets(true);
+	FLXRTraceTargetArray TraceTargets;
+	GetTraceTargets(true, TraceTargets);
+	return TArray<FVector>(TraceTargets);
 }
 
 TArray<AActor*> ULXRDetectionComponent::GetPassedLights() const
 {
 	TArray<AActor*> ReturnList;
-	for (auto It = RelevantLightsPassed.CreateConstIterator(); It; ++It)
+	ReturnList.Reserve(GetPassedLightCount());
+	for (FLXRPassedLightIterator It = CreatePassedLightIterator(); It; ++It)
 	{
-		ReturnList.Add(It->Get());
+		ReturnList.Add(It.GetLightSourceOwner());
 	}
 
 	return ReturnList;
@@ -1848,28 +2850,92 @@ TArray<AActor*> ULXRDetectionComponent::GetPassedLights() const
 TArray<ULightComponent*> ULXRDetectionComponent::GetPassedLightComponents(AActor* LightSourceOwner)
 {
 	if (!IsValid(LightSourceOwner)) return {};
+
 	TArray<ULightComponent*> ReturnList;
-	TArray<ULightComponent*> LightSourceComponents = Cast<ULXRSourceComponent>(LightSourceOwner->GetComponentByClass(ULXRSourceComponent::StaticClass()))->GetMyLightComponents();
-	auto ComponentIndexes = LightsPassedComponents[LightSourceOwner];
-	for (const auto Idx : ComponentIndexes)
+	for (FLXRPassedComponentIterator It = CreatePassedLightComponentIterator(LightSourceOwner); It; ++It)
 	{
-		ReturnList.Add(LightSourceComponents[Idx]);
+		ReturnList.Add(*It);
 	}
 
 	return ReturnList;
 }
 
-TArray<FVector> ULXRDetectionComponent::GetTraceTargets(const bool& bIsRelevant, const ETraceTarget TargetOverride) const
+int32 ULXRDetectionComponent::GetPassedLightCount() const
+{
+	return PassedLightSlots.Num();
+}
+
+FLXRPassedLightIterator ULXRDetectionComponent::CreatePassedLightIterator() const
+{
+	return FLXRPassedLightIterator(LightPairs, PassedLightSlots);
+}
+
+FLXRPassedComponentIterator ULXRDetectionComponent::CreatePassedLightComponentIterator(const AActor* LightSourceOwner) const
 {
-	// TArray<FVector,TFixedAllocator<64>> Temp;
-	TArray<FVector> Temp;
+	const int32 PairSlot = FindLightPairSlot(LightSourceOwner);
+	if (PairSlot == INDEX_NONE || !LightPairs[PairSlot].LightSourceComponent.IsValid())
+		return FLXRPassedComponentIterator({}, NoPassedComponents);
+
+	const FLXRLightPair& LightPair = LightPairs[PairSlot];
+	return FLXRPassedComponentIterator(LightPair.LightSourceComponent->GetLightComponentsView(), LightPair.PassedComponents);
+}
+
+FLXRPassedComponentIterator::FLXRPassedComponentIterator(TConstArrayView<ULightComponent*> InLightComponents, const FLXRComponentBitArray& InPassedComponents)
+	: LightComponents(InLightComponents), PassedComponentIt(InPassedComponents)
+{
+	SkipInvalidComponents();
+}
+
+FLXRPassedComponentIterator& FLXRPassedComponentIterator::operator++()
+{
+	++PassedComponentIt;
+	SkipInvalidComponents();
+	return *this;
+}
+
+void FLXRPassedComponentIterator::SkipInvalidComponents()
+{
+	//Light components can be removed from source after the check.
+	while (PassedComponentIt && !LightComponents.IsValidIndex(GetComponentIndex()))
+	{
+		++PassedComponentIt;
+	}
+}
+
+FLXRPassedLightIterator::FLXRPassedLightIterator(const TSparseArray<FLXRLightPair>& InLightPairs, TConstArrayView<int32> InPassedLightSlots)
+	: LightPairs(InLightPairs), PassedLightSlots(InPassedLightSlots)
+{
+}
+
+AActor* FLXRPassedLightIterator::GetLightSourceOwner() const
+{
+	return GetLightPair().LightSourceOwner.Get();
+}
+
+ULXRSourceComponent* FLXRPassedLightIterator::GetLightSourceComponent() const
+{
+	return GetLightPair().LightSourceComponent.Get();
+}
+
+FLXRPassedComponentIterator FLXRPassedLightIterator::CreatePassedComponentIterator() const
+{
+	const FLXRLightPair& LightPair = GetLightPair();
+	if (!LightPair.LightSourceComponent.IsValid())
+		return FLXRPassedComponentIterator({}, NoPassedComponents);
+
+	return FLXRPassedComponentIterator(LightPair.LightSourceComponent->GetLightComponentsView(), LightPair.PassedComponents);
+}
+
+void ULXRDetectionComponent::GetTraceTargets(bool bIsRelevant, FLXRTraceTargetArray& OutTraceTargets, const ETraceTarget TargetOverride) const
+{
+	OutTraceTargets.Reset();
 
 	const ETraceTarget TargetType = TargetOverride != ETraceTarget::None ? TargetOverride : bIsRelevant ? RelevantTargetType : RelevancyTargetType;
 	switch (TargetType)
 	{
 		case ETraceTarget::ActorLocation:
 			{
-				Temp.AddUnique(GetOwner()->GetActorLocation());
+				OutTraceTargets.AddUnique(GetOwner()->GetActorLocation());
 				break;
 			}
 		case ETraceTarget::Sockets:
@@ -1882,7 +2948,7 @@ TArray<FVector> ULXRDetectionComponent::GetTraceTargets(const bool& bIsRelevant,
 						{
 							if (SkeletalMeshComponent->DoesSocketExist(Socket))
 							{
-								Temp.AddUnique(SkeletalMeshComponent->GetSocketLocation(Socket));
+								OutTraceTargets.AddUnique(SkeletalMeshComponent->GetSocketLocation(Socket));
 							}
 							else
 							{
@@ -1898,7 +2964,7 @@ TArray<FVector> ULXRDetectionComponent::GetTraceTargets(const bool& bIsRelevant,
 			{
 				for (auto Vector : TargetVectors)
 				{
-					Temp.Add(GetOwner()->GetTransform().TransformPosition(Vector));
+					OutTraceTargets.Add(GetOwner()->GetTransform().TransformPosition(Vector));
 				}
 			}
 			break;
@@ -1908,13 +2974,13 @@ TArray<FVector> ULXRDetectionComponent::GetTraceTargets(const bool& bIsRelevant,
 				FVector Extent;
 				GetOwner()->GetActorBounds(true, Origin, Extent);
 				Extent = Extent / 1.2;
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, 0, Extent.Z)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, 0, -Extent.Z + 15)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, Extent.Y * 0.5, Extent.Z * 0.1)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, -Extent.Y * 0.5, Extent.Z * 0.1)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, -Extent.Y * 0.5, Extent.Z * 0.1)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(Extent.X * 0.5, 0, 0)));
-				Temp.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(-Extent.X * 0.5, 0, 0)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, 0, Extent.Z)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, 0, -Extent.Z + 15)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, Extent.Y * 0.5, Extent.Z * 0.1)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, -Extent.Y * 0.5, Extent.Z * 0.1)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(0, -Extent.Y * 0.5, Extent.Z * 0.1)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(Extent.X * 0.5, 0, 0)));
+				OutTraceTargets.AddUnique(GetOwner()->GetTransform().TransformPosition(FVector(-Extent.X * 0.5, 0, 0)));
 			}
 			break;
 		case ETraceTarget::None:
@@ -1922,15 +2988,11 @@ TArray<FVector> ULXRDetectionComponent::GetTraceTargets(const bool& bIsRelevant,
 		default:
 			break;
 	}
-	return Temp;
 }
 
 bool ULXRDetectionComponent::CheckDirection(const ULightComponent& LightComponent, const FVector& Start, const FVector& End) const
 {
-	const float Dot = FVector::DotProduct(LightComponent.GetForwardVector(), (Start - End).GetSafeNormal());
-	if (Dot > 0)
-		return true;
-	return false;
+	return LXRRelevancy::IsFacing(LightComponent.GetForwardVector(), Start, End);
 }
 
 bool ULXRDetectionComponent::CheckAttenuation(const ULightComponent& LightComponent, const FVector& Start, const FVector& End, bool IsRect) const
@@ -0,0 +1,283 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRFrameSnapshot.h"
+#include "LXRDetectionComponent.h"
+#include "LXRSourceComponent.h"
+#include "Components/DirectionalLightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "Components/SpotLightComponent.h"
+
+void FLXRFrameSnapshot::Reset()
+{
+	Lights.Reset();
+	LightComponents.Reset();
+	Detectors.Reset();
+	TraceTargets.Reset();
+	LightIndices.Reset();
+	DetectorIndices.Reset();
+	bSoloFound = false;
+}
+
+void FLXRFrameSnapshot::AddLight(const ULXRSourceComponent& LightSourceComponent)
+{
+	FLXRLightRecord& Light = Lights.AddDefaulted_GetRef();
+	Light.LightSourceOwner = LightSourceComponent.GetOwner();
+	Light.Location = LightSourceComponent.GetOwner()->GetActorLocation();
+	Light.AttenuationMultiplierToBeRelevant = LightSourceComponent.AttenuationMultiplierToBeRelevant;
+	Light.bEnabled = LightSourceComponent.IsEnabled();
+	Light.bAlwaysRelevant = LightSourceComponent.bAlwaysRelevant;
+	Light.bSolo = LightSourceComponent.bSolo;
+	Light.FirstComponent = LightComponents.Num();
+
+	for (const ULightComponent* LightComponent : LightSourceComponent.GetLightComponentsView())
+	{
+		FLXRLightComponentRecord& Record = LightComponents.AddDefaulted_GetRef();
+		if (!IsValid(LightComponent))
+			continue;
+
+		Record.Transform = LightComponent->GetComponentTransform();
+		Record.Intensity = LightComponent->Intensity;
+		Record.Color = LightComponent->bUseTemperature ? FLinearColor::MakeFromColorTemperature(LightComponent->Temperature) * LightComponent->GetLightColor() : LightComponent->GetLightColor();
+		Record.bEnabled = LightSourceComponent.IsLightComponentEnabled(LightComponent);
+
+		if (const USpotLightComponent* SpotLightComponent = Cast<USpotLightComponent>(LightComponent))
+		{
+			Record.Shape = ELXRLightShape::Spot;
+			Record.AttenuationRadius = SpotLightComponent->AttenuationRadius;
+			Record.OuterConeAngle = SpotLightComponent->OuterConeAngle;
+		}
+		else if (const UPointLightComponent* PointLightComponent = Cast<UPointLightComponent>(LightComponent))
+		{
+			Record.Shape = ELXRLightShape::Point;
+			Record.AttenuationRadius = PointLightComponent->AttenuationRadius;
+		}
+		else if (const URectLightComponent* RectLightComponent = Cast<URectLightComponent>(LightComponent))
+		{
+			Record.Shape = ELXRLightShape::Rect;
+			Record.AttenuationRadius = RectLightComponent->AttenuationRadius;
+			Record.SourceWidth = RectLightComponent->SourceWidth;
+			Record.SourceHeight = RectLightComponent->SourceHeight;
+			Record.BarnDoorAngle = FMath::Clamp(RectLightComponent->BarnDoorAngle, 0.f, GetRectLightBarnDoorMaxAngle());
+			Record.BarnDoorLength = RectLightComponent->BarnDoorLength;
+		}
+		else
+		{
+			Record.Shape = ELXRLightShape::Directional;
+		}
+	}
+
+	Light.NumComponents = LightComponents.Num() - Light.FirstComponent;
+	bSoloFound |= Light.bSolo;
+	LightIndices.Add(Light.LightSourceOwner, Lights.Num() - 1);
+}
+
+void FLXRFrameSnapshot::AddDetector(const ULXRDetectionComponent& DetectionComponent)
+{
+	FLXRDetectorRecord& Detector = Detectors.AddDefaulted_GetRef();
+	Detector.DetectionComponent = &DetectionComponent;
+	Detector.Location = DetectionComponent.GetOwner()->GetActorLocation();
+
+	FLXRTraceTargetArray DetectorTraceTargets;
+	DetectionComponent.GetTraceTargets(true, DetectorTraceTargets);
+	Detector.FirstRelevantTarget = TraceTargets.Num();
+	Detector.NumRelevantTargets = DetectorTraceTargets.Num();
+	TraceTargets.Append(DetectorTraceTargets);
+
+	DetectionComponent.GetTraceTargets(false, DetectorTraceTargets);
+	Detector.FirstRelevancyTarget = TraceTargets.Num();
+	Detector.NumRelevancyTargets = DetectorTraceTargets.Num();
+	TraceTargets.Append(DetectorTraceTargets);
+
+	DetectorIndices.Add(Detector.DetectionComponent, Detectors.Num() - 1);
+}
+
+const FLXRLightRecord* FLXRFrameSnapshot::FindLight(const AActor* LightSourceOwner) const
+{
+	const int32* Index = LightIndices.Find(LightSourceOwner);
+	return Index ? &Lights[*Index] : NULL;
+}
+
+const FLXRDetectorRecord* FLXRFrameSnapshot::FindDetector(const ULXRDetectionComponent* DetectionComponent) const
+{
+	const int32* Index = DetectorIndices.Find(DetectionComponent);
+	return Index ? &Detectors[*Index] : NULL;
+}
+
+TConstArrayView<FLXRLightComponentRecord> FLXRFrameSnapshot::GetLightComponents(const FLXRLightRecord& Light) const
+{
+	return MakeArrayView(LightComponents.GetData() + Light.FirstComponent, Light.NumComponents);
+}
+
+TConstArrayView<FVector> FLXRFrameSnapshot::GetTraceTargets(const FLXRDetectorRecord& Detector, bool bIsRelevant) const
+{
+	return bIsRelevant
+		       ? MakeArrayView(TraceTargets.GetData() + Detector.FirstRelevantTarget, Detector.NumRelevantTargets)
+		       : MakeArrayView(TraceTargets.GetData() + Detector.FirstRelevancyTarget, Detector.NumRelevancyTargets);
+}
+
+bool LXRRelevancy::IsInsideRadius(const FVector& Start, const FVector& End, float Radius)
+{
+	return FVector::DistSquared(Start, End) < Radius * Radius;
+}
+
+bool LXRRelevancy::IsFacing(const FVector& Forward, const FVector& Start, const FVector& End)
+{
+	return FVector::DotProduct(Forward, (Start - End).GetSafeNormal()) > 0;
+}
+
+bool LXRRelevancy::IsInsideCone(const FVector& Forward, const FVector& Start, const FVector& End, float ConeAngle)
+{
+	const float Dot = FVector::DotProduct(Forward, (Start - End).GetSafeNormal());
+	return FMath::RadiansToDegrees(acosf(Dot)) < ConeAngle;
+}
+
+bool LXRRelevancy::IsInsideRectLight(const FLXRLightComponentRecord& LightComponent, const FVector& Start)
+{
+	auto CheckForLinePlaneIntersectionAndFindClosestPointOnSegment([](const FVector& LineStart, const FVector& LineEnd, const FVector& PlaneNormal, const FVector& EdgeStart, const FVector& EdgeEnd, FVector& Intersection)
+	{
+		const FVector RayDir = LineEnd - LineStart;
+		if ((RayDir | PlaneNormal) == 0.0f)
+			return false;
+
+		const float T = (((EdgeEnd - LineStart) | PlaneNormal) / (RayDir | PlaneNormal));
+		if (T < 0.0f || T > 1.0f)
+			return false;
+
+		Intersection = LineStart + RayDir * T;
+		return FMath::ClosestPointOnSegment(Intersection, EdgeStart, EdgeEnd).Equals(Intersection, 0.01);
+	});
+
+	const FTransform& Transform = LightComponent.Transform;
+	const FVector End = Transform.GetLocation();
+	const FVector Forward = Transform.GetUnitAxis(EAxis::X);
+	const FVector Right = Transform.GetUnitAxis(EAxis::Y);
+	const FVector Up = Transform.GetUnitAxis(EAxis::Z);
+
+	const FVector DetectionProjectedToRectPlane = FVector::PointPlaneProject(Start, End, Forward);
+	const FVector LocalProjected = Transform.InverseTransformPosition(DetectionProjectedToRectPlane);
+	const FVector AbsLocalProjected = LocalProjected.GetAbs();
+	if (AbsLocalProjected.Z < LightComponent.SourceHeight / 2 && AbsLocalProjected.Y < LightComponent.SourceWidth / 2)
+		return true;
+
+	const FVector Test = Transform.TransformPosition(LocalProjected * -1);
+	const float HalfWidth = 0.5f * LightComponent.SourceWidth;
+	const float HalfHeight = 0.5f * LightComponent.SourceHeight;
+	const float AngleRad = FMath::DegreesToRadians(LightComponent.BarnDoorAngle);
+	const float BarnDepth = FMath::Cos(AngleRad) * LightComponent.BarnDoorLength;
+	const float BarnExtent = FMath::Sin(AngleRad) * LightComponent.BarnDoorLength;
+
+	const FVector V1 = Transform.TransformPosition(FVector(0.0f, +HalfWidth, +HalfHeight));
+	const FVector V2 = Transform.TransformPosition(FVector(0.0f, +HalfWidth, -HalfHeight));
+	const FVector V3 = Transform.TransformPosition(FVector(0.0f, -HalfWidth, +HalfHeight));
+	const FVector V4 = Transform.TransformPosition(FVector(0.0f, -HalfWidth, -HalfHeight));
+	const FVector BarnV1 = Transform.TransformPosition(FVector(BarnDepth, +HalfWidth + BarnExtent, +HalfHeight + BarnExtent));
+	const FVector BarnV2 = Transform.TransformPosition(FVector(BarnDepth, +HalfWidth + BarnExtent, -HalfHeight - BarnExtent));
+	const FVector BarnV3 = Transform.TransformPosition(FVector(BarnDepth, -HalfWidth - BarnExtent, +HalfHeight + BarnExtent));
+	const FVector BarnV4 = Transform.TransformPosition(FVector(BarnDepth, -HalfWidth - BarnExtent, -HalfHeight - BarnExtent));
+
+	//Target is outside rect, it is lit if it is inside the barn door opening past the crossed edge.
+	auto CheckBarnEdge = [&](const FVector& EdgeIntersection, const FVector& BarnMid)
+	{
+		const float Dot = FVector::DotProduct(Forward, (BarnMid - EdgeIntersection).GetSafeNormal());
+		const float Angle = FMath::RadiansToDegrees(acosf(Dot));
+		const float TargetDot = FVector::DotProduct(Forward, (Start - EdgeIntersection).GetSafeNormal());
+		return FMath::RadiansToDegrees(acosf(TargetDot)) < Angle;
+	};
+
+	FVector EdgeIntersection;
+	if (CheckForLinePlaneIntersectionAndFindClosestPointOnSegment(End, Test, Up, V1, V3, EdgeIntersection))
+		return CheckBarnEdge(EdgeIntersection, ((BarnV2 - BarnV4) * 0.5f) + BarnV4);
+
+	if (CheckForLinePlaneIntersectionAndFindClosestPointOnSegment(End, Test, Up * -1, V2, V4, EdgeIntersection))
+		return CheckBarnEdge(EdgeIntersection, ((BarnV1 - BarnV3) * 0.5f) + BarnV3);
+
+	if (CheckForLinePlaneIntersectionAndFindClosestPointOnSegment(End, Test, Right, V1, V2, EdgeIntersection))
+		return CheckBarnEdge(EdgeIntersection, ((BarnV3 - BarnV4) * 0.5f) + BarnV4);
+
+	if (CheckForLinePlaneIntersectionAndFindClosestPointOnSegment(End, Test, Right * -1, V3, V4, EdgeIntersection))
+		return CheckBarnEdge(EdgeIntersection, ((BarnV1 - BarnV2) * 0.5f) + BarnV2);
+
+	return false;
+}
+
+bool LXRRelevancy::IsLightComponentRelevant(const FLXRLightRecord& Light, const FLXRLightComponentRecord& LightComponent, const FVector& Start)
+{
+	if (LightComponent.Shape == ELXRLightShape::Directional)
+		return true;
+
+	const FVector End = LightComponent.GetLocation();
+	if (!IsInsideRadius(Start, End, LightComponent.AttenuationRadius * Light.AttenuationMultiplierToBeRelevant))
+		return false;
+
+	if (LightComponent.Shape != ELXRLightShape::Point && !IsFacing(LightComponent.GetForwardVector(), Start, End))
+		return false;
+
+	if (!IsInsideRadius(Start, End, LightComponent.AttenuationRadius))
+		return false;
+
+	switch (LightComponent.Shape)
+	{
+		case ELXRLightShape::Spot:
+			return IsInsideCone(LightComponent.GetForwardVector(), Start, End, LightComponent.OuterConeAngle);
+		case ELXRLightShape::Rect:
+			return IsInsideRectLight(LightComponent, Start);
+		default: ;
+	}
+	return true;
+}
+
+bool LXRRelevancy::IsLightRelevant(const FLXRFrameSnapshot& Snapshot, const FLXRLightRecord& Light, TConstArrayView<FVector> TraceTargets, float RequiredChecksToPass, FLXRIndexArray& OutPassedComponents)
+{
+	OutPassedComponents.Reset();
+
+	int PassedChecks = 0;
+	bool Passed = false;
+	const TConstArrayView<FLXRLightComponentRecord> LightComponents = Snapshot.GetLightComponents(Light);
+	for (int ComponentIdx = 0; ComponentIdx < LightComponents.Num(); ++ComponentIdx)
+	{
+		const FLXRLightComponentRecord& LightComponent = LightComponents[ComponentIdx];
+		if (!LightComponent.bEnabled)
+			continue;
+
+		for (const FVector& TraceTarget : TraceTargets)
+		{
+			if (IsLightComponentRelevant(Light, LightComponent, TraceTarget))
+			{
+				PassedChecks++;
+				OutPassedComponents.AddUnique(ComponentIdx);
+			}
+		}
+
+		if (PassedChecks >= RequiredChecksToPass)
+			Passed = true;
+	}
+
+	if (!Passed)
+		OutPassedComponents.Reset();
+
+	return Passed;
+}
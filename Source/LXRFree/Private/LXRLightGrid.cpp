@@ -0,0 +1,266 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRLightGrid.h"
+#include "LXRFree.h"
+#include "LXRSourceComponent.h"
+#include "LXRSubsystem.h"
+#include "Components/DirectionalLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "Engine/Level.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+ALXRLightGrid::ALXRLightGrid()
+{
+	PrimaryActorTick.bCanEverTick = false;
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+}
+
+void ALXRLightGrid::BeginPlay()
+{
+	Super::BeginPlay();
+
+	LXRSubsystem = GetWorld()->GetSubsystem<ULXRSubsystem>();
+
+	TWeakObjectPtr<ALXRLightGrid> WeakThis(this);
+	CellLightsPayload.LoadAsync([WeakThis](TArray<uint8>&& Bytes)
+	{
+		ALXRLightGrid* LightGrid = WeakThis.Get();
+		if (!LightGrid)
+			return;
+
+		//Empty if grid was never baked.
+		if (Bytes.Num() > 0)
+		{
+			FMemoryReader Ar(Bytes);
+			LightGrid->SerializeCellLights(Ar);
+		}
+		LightGrid->LXRSubsystem->RegisterLightGrid(LightGrid);
+	});
+}
+
+void ALXRLightGrid::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CellLightsPayload.Cancel();
+	if (LXRSubsystem)
+		LXRSubsystem->UnregisterLightGrid(this);
+
+	if (!CellLightsPayload.IsEmpty())
+	{
+		CellLightOffsets.Empty();
+		CellLightIndices.Empty();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ALXRLightGrid::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+	CellLightsPayload.Serialize(Ar, this);
+}
+
+void ALXRLightGrid::SerializeCellLights(FArchive& Ar)
+{
+	Ar << CellLightOffsets;
+	Ar << CellLightIndices;
+}
+
+void ALXRLightGrid::BakeLightGrid()
+{
+	Modify();
+	Lights.Reset();
+	CellLightOffsets.Reset();
+	CellLightIndices.Reset();
+	GridSize = FIntVector::ZeroValue;
+
+	struct FBakeLight
+	{
+		TArray<ULightComponent*> LightComponents;
+		float RadiusMultiplier;
+		FBox Bounds;
+	};
+	TArray<FBakeLight> BakeLights;
+	FBox GridBounds(ForceInit);
+
+	for (AActor* Actor : GetLevel()->Actors)
+	{
+		const ULXRSourceComponent* LightSourceComponent = Actor ? Cast<ULXRSourceComponent>(Actor->GetComponentByClass(ULXRSourceComponent::StaticClass())) : NULL;
+		if (!LightSourceComponent || LightSourceComponent->bAlwaysRelevant)
+			continue;
+
+		FBakeLight BakeLight;
+		BakeLight.RadiusMultiplier = LightSourceComponent->AttenuationMultiplierToBeRelevant;
+		BakeLight.Bounds.Init();
+		LightSourceComponent->GetLightComponents(BakeLight.LightComponents);
+
+		//Whole light source must stay where it was baked.
+		bool bBakeable = BakeLight.LightComponents.Num() > 0;
+		for (const ULightComponent* LightComponent : BakeLight.LightComponents)
+		{
+			const ULocalLightComponent* LocalLight = Cast<ULocalLightComponent>(LightComponent);
+			if (!LocalLight || LocalLight->Mobility == EComponentMobility::Movable)
+			{
+				bBakeable = false;
+				break;
+			}
+
+			BakeLight.Bounds += FBox::BuildAABB(LocalLight->GetComponentLocation(), FVector(LocalLight->AttenuationRadius * BakeLight.RadiusMultiplier));
+		}
+
+		if (!bBakeable)
+			continue;
+
+		Lights.Add(Actor);
+		GridBounds += BakeLight.Bounds;
+		BakeLights.Add(MoveTemp(BakeLight));
+	}
+
+	if (Lights.Num() == 0)
+	{
+		UE_LOG(LogLightSystem, Warning, TEXT("%s: no static LXR lights to bake"), *GetName());
+		CellLightsPayload.Store({});
+		return;
+	}
+
+	BakedCellSize = CellSize;
+	const FVector Size = GridBounds.GetSize();
+	const double CellCount = FMath::Max(Size.X / BakedCellSize, 1.) * FMath::Max(Size.Y / BakedCellSize, 1.) * FMath::Max(Size.Z / BakedCellSize, 1.);
+	if (CellCount > MaxCells)
+		BakedCellSize *= FMath::Pow(CellCount / MaxCells, 1. / 3.) * 1.01f;
+
+	GridOrigin = GridBounds.Min;
+	GridSize = FIntVector(
+		FMath::Max(FMath::CeilToInt(Size.X / BakedCellSize), 1),
+		FMath::Max(FMath::CeilToInt(Size.Y / BakedCellSize), 1),
+		FMath::Max(FMath::CeilToInt(Size.Z / BakedCellSize), 1));
+
+	//Light and cell pairs, counting sorted by cell into the flat layout.
+	TArray<TPair<int32, int32>> CellLightPairs;
+	for (int LightIndex = 0; LightIndex < BakeLights.Num(); ++LightIndex)
+	{
+		const FBakeLight& BakeLight = BakeLights[LightIndex];
+		const FIntVector MinCell = FIntVector((BakeLight.Bounds.Min - GridOrigin) / BakedCellSize);
+		const FIntVector MaxCell = FIntVector((BakeLight.Bounds.Max - GridOrigin) / BakedCellSize);
+		for (int32 Z = FMath::Max(MinCell.Z, 0); Z <= FMath::Min(MaxCell.Z, GridSize.Z - 1); ++Z)
+		{
+			for (int32 Y = FMath::Max(MinCell.Y, 0); Y <= FMath::Min(MaxCell.Y, GridSize.Y - 1); ++Y)
+			{
+				for (int32 X = FMath::Max(MinCell.X, 0); X <= FMath::Min(MaxCell.X, GridSize.X - 1); ++X)
+				{
+					const FVector CellMin = GridOrigin + FVector(X, Y, Z) * BakedCellSize;
+					const FBox CellBox(CellMin, CellMin + FVector(BakedCellSize));
+					for (const ULightComponent* LightComponent : BakeLight.LightComponents)
+					{
+						if (DoesLightAffectBox(*LightComponent, BakeLight.RadiusMultiplier, CellBox))
+						{
+							CellLightPairs.Emplace(X + Y * GridSize.X + Z * GridSize.X * GridSize.Y, LightIndex);
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	CellLightOffsets.SetNumZeroed(GridSize.X * GridSize.Y * GridSize.Z + 1);
+	for (const TPair<int32, int32>& CellLight : CellLightPairs)
+		CellLightOffsets[CellLight.Key + 1]++;
+
+	for (int Cell = 1; Cell < CellLightOffsets.Num(); ++Cell)
+		CellLightOffsets[Cell] += CellLightOffsets[Cell - 1];
+
+	TArray<int32> WriteOffsets(CellLightOffsets);
+	CellLightIndices.SetNumUninitialized(CellLightPairs.Num());
+	for (const TPair<int32, int32>& CellLight : CellLightPairs)
+		CellLightIndices[WriteOffsets[CellLight.Key]++] = CellLight.Value;
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Ar(Bytes);
+	SerializeCellLights(Ar);
+	CellLightsPayload.Store(Bytes);
+
+	UE_LOG(LogLightSystem, Log, TEXT("%s: baked %d lights into %d x %d x %d cells of %.0f, %d cell lights"), *GetName(), Lights.Num(), GridSize.X, GridSize.Y, GridSize.Z, BakedCellSize, CellLightIndices.Num());
+}
+
+void ALXRLightGrid::GetCellLights(const FVector& Location, TArray<AActor*>& OutLights) const
+{
+	if (BakedCellSize <= 0 || CellLightOffsets.Num() != GridSize.X * GridSize.Y * GridSize.Z + 1)
+		return;
+
+	const FVector Local = (Location - GridOrigin) / BakedCellSize;
+	const FIntVector Cell(FMath::FloorToInt(Local.X), FMath::FloorToInt(Local.Y), FMath::FloorToInt(Local.Z));
+	if (Cell.X < 0 || Cell.Y < 0 || Cell.Z < 0 || Cell.X >= GridSize.X || Cell.Y >= GridSize.Y || Cell.Z >= GridSize.Z)
+		return;
+
+	const int32 CellIndex = Cell.X + Cell.Y * GridSize.X + Cell.Z * GridSize.X * GridSize.Y;
+	for (int32 i = CellLightOffsets[CellIndex]; i < CellLightOffsets[CellIndex + 1]; ++i)
+	{
+		if (AActor* Light = Lights[CellLightIndices[i]].Get())
+			OutLights.Add(Light);
+	}
+}
+
+bool ALXRLightGrid::DoesLightAffectBox(const ULightComponent& LightComponent, float RadiusMultiplier, const FBox& Box)
+{
+	const ULocalLightComponent* LocalLight = Cast<ULocalLightComponent>(&LightComponent);
+	if (!LocalLight)
+		return false;
+
+	const FVector LightLocation = LocalLight->GetComponentLocation();
+	const float Radius = LocalLight->AttenuationRadius * RadiusMultiplier;
+	if (Box.ComputeSquaredDistanceToPoint(LightLocation) > Radius * Radius)
+		return false;
+
+	const FVector Forward = LocalLight->GetForwardVector();
+	if (const USpotLightComponent* SpotLight = Cast<USpotLightComponent>(LocalLight))
+	{
+		//Sphere against cone.
+		const float BoxRadius = Box.GetExtent().Size();
+		const FVector ToCenter = Box.GetCenter() - LightLocation;
+		const float AlongCone = ToCenter | Forward;
+		const float Angle = FMath::DegreesToRadians(FMath::Clamp(SpotLight->OuterConeAngle, 0.f, 89.f));
+		const float FromAxis = FMath::Sqrt(FMath::Max(ToCenter.SizeSquared() - AlongCone * AlongCone, 0.f));
+		const float DistanceToCone = FMath::Cos(Angle) * FromAxis - FMath::Sin(Angle) * AlongCone;
+		return DistanceToCone <= BoxRadius && AlongCone >= -BoxRadius;
+	}
+
+	if (LocalLight->IsA(URectLightComponent::StaticClass()))
+	{
+		//Rect light only lights the half space in front of it.
+		FVector Corners[8];
+		Box.GetVertices(Corners);
+		for (const FVector& Corner : Corners)
+		{
+			if (((Corner - LightLocation) | Forward) >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,193 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRLightOcclusionMap.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Engine/World.h"
+#include "CollisionQueryParams.h"
+#include "Async/ParallelFor.h"
+
+bool FLXRLightOcclusionMap::IsBakedFrom(const ULightComponent& LightComponent, int32 InResolution) const
+{
+	if (!IsValid())
+		return false;
+
+	//Un-hit texels store MaxDepth, a map of a grown light would report everything past the old radius occluded.
+	const FLXRLightOcclusionMap Current = Create(LightComponent, InResolution);
+	return Type == Current.Type && Resolution == Current.Resolution
+		&& LightTransform.GetLocation().Equals(Current.LightTransform.GetLocation(), 1.f)
+		&& LightTransform.GetRotation().Equals(Current.LightTransform.GetRotation(), KINDA_SMALL_NUMBER)
+		&& FMath::IsNearlyEqual(MaxDepth, Current.MaxDepth, 1.f)
+		&& FMath::IsNearlyEqual(TanHalfAngle, Current.TanHalfAngle, KINDA_SMALL_NUMBER);
+}
+
+bool FLXRLightOcclusionMap::Sample(const FVector& Point, float DepthBias, bool& OutVisible) const
+{
+	if (!IsValid())
+		return false;
+
+	const FVector ToPoint = Point - LightTransform.GetLocation();
+	int32 Face;
+	float U;
+	float V;
+	if (!GetFaceCoordinates(ToPoint, Face, U, V))
+		return false;
+
+	const int32 X = FMath::Min(FMath::FloorToInt((U * 0.5f + 0.5f) * Resolution), Resolution - 1);
+	const int32 Y = FMath::Min(FMath::FloorToInt((V * 0.5f + 0.5f) * Resolution), Resolution - 1);
+	const float Depth = DecodeDepth(Depths[Face * Resolution * Resolution + X + Y * Resolution]);
+
+	OutVisible = ToPoint.Size() <= Depth + DepthBias;
+	return true;
+}
+
+bool FLXRLightOcclusionMap::GetFaceCoordinates(const FVector& Direction, int32& OutFace, float& OutU, float& OutV) const
+{
+	if (Type == ELXROcclusionMapType::Spot)
+	{
+		//Light looks along local X, map plane spans Y and Z.
+		const FVector LocalDirection = LightTransform.InverseTransformVectorNoScale(Direction);
+		if (LocalDirection.X <= KINDA_SMALL_NUMBER)
+			return false;
+
+		OutFace = 0;
+		OutU = LocalDirection.Y / (LocalDirection.X * TanHalfAngle);
+		OutV = LocalDirection.Z / (LocalDirection.X * TanHalfAngle);
+		return FMath::Abs(OutU) <= 1.f && FMath::Abs(OutV) <= 1.f;
+	}
+
+	//Cube face is picked by dominant axis, remaining two axes in axis order are the map plane.
+	const FVector Abs = Direction.GetAbs();
+	float Major;
+	if (Abs.X >= Abs.Y && Abs.X >= Abs.Z)
+	{
+		OutFace = Direction.X > 0 ? 0 : 1;
+		Major = Abs.X;
+		OutU = Direction.Y;
+		OutV = Direction.Z;
+	}
+	else if (Abs.Y >= Abs.Z)
+	{
+		OutFace = Direction.Y > 0 ? 2 : 3;
+		Major = Abs.Y;
+		OutU = Direction.X;
+		OutV = Direction.Z;
+	}
+	else
+	{
+		OutFace = Direction.Z > 0 ? 4 : 5;
+		Major = Abs.Z;
+		OutU = Direction.X;
+		OutV = Direction.Y;
+	}
+
+	if (Major <= KINDA_SMALL_NUMBER)
+		return false;
+
+	OutU /= Major;
+	OutV /= Major;
+	return true;
+}
+
+FVector FLXRLightOcclusionMap::GetTexelDirection(int32 Texel) const
+{
+	const int32 FaceTexels = Resolution * Resolution;
+	const int32 Face = Texel / FaceTexels;
+	const int32 FaceTexel = Texel % FaceTexels;
+	const float U = (FaceTexel % Resolution + 0.5f) / Resolution * 2.f - 1.f;
+	const float V = (FaceTexel / Resolution + 0.5f) / Resolution * 2.f - 1.f;
+
+	if (Type == ELXROcclusionMapType::Spot)
+		return LightTransform.TransformVectorNoScale(FVector(1.f, U * TanHalfAngle, V * TanHalfAngle).GetSafeNormal());
+
+	const float Sign = Face % 2 == 0 ? 1.f : -1.f;
+	switch (Face / 2)
+	{
+	case 0:
+		return FVector(Sign, U, V).GetSafeNormal();
+	case 1:
+		return FVector(U, Sign, V).GetSafeNormal();
+	default:
+		return FVector(U, V, Sign).GetSafeNormal();
+	}
+}
+
+void FLXRLightOcclusionMap::BakeTexels(const UWorld& World, int32 FirstTexel, int32 Count, const FCollisionQueryParams& QueryParams)
+{
+	Depths.SetNumUninitialized(GetTexelCount());
+	Count = FMath::Min(Count, Depths.Num() - FirstTexel);
+	if (FirstTexel < 0 || Count <= 0)
+		return;
+
+	const FVector Start = LightTransform.GetLocation();
+	const FCollisionObjectQueryParams ObjectQueryParams(ECC_WorldStatic);
+	ParallelFor(Count, [&](int32 Index)
+	{
+		const int32 Texel = FirstTexel + Index;
+		FHitResult Hit;
+		float Depth = MaxDepth;
+		if (World.LineTraceSingleByObjectType(Hit, Start, Start + GetTexelDirection(Texel) * MaxDepth, ObjectQueryParams, QueryParams))
+			Depth = Hit.Distance;
+
+		Depths[Texel] = EncodeDepth(Depth, MaxDepth);
+	});
+}
+
+FLXRLightOcclusionMap FLXRLightOcclusionMap::Create(const ULightComponent& LightComponent, int32 Resolution)
+{
+	FLXRLightOcclusionMap Map;
+	//Spot light is a point light subclass, check it first.
+	if (const USpotLightComponent* SpotLight = Cast<USpotLightComponent>(&LightComponent))
+	{
+		Map.Type = ELXROcclusionMapType::Spot;
+		Map.Resolution = FMath::Max(Resolution, 1);
+		Map.LightTransform = FTransform(SpotLight->GetComponentQuat(), SpotLight->GetComponentLocation());
+		Map.MaxDepth = SpotLight->AttenuationRadius;
+		Map.TanHalfAngle = FMath::Tan(FMath::DegreesToRadians(FMath::Clamp(SpotLight->OuterConeAngle, 1.f, 89.f)));
+	}
+	else if (const UPointLightComponent* PointLight = Cast<UPointLightComponent>(&LightComponent))
+	{
+		Map.Type = ELXROcclusionMapType::Cube;
+		Map.Resolution = FMath::Max(Resolution, 1);
+		Map.LightTransform = FTransform(PointLight->GetComponentLocation());
+		Map.MaxDepth = PointLight->AttenuationRadius;
+		Map.TanHalfAngle = 1.f;
+	}
+	return Map;
+}
+
+uint16 FLXRLightOcclusionMap::EncodeDepth(float Depth, float MaxDepth)
+{
+	if (MaxDepth <= 0)
+		return 0;
+
+	return (uint16)FMath::Clamp(FMath::CeilToInt(Depth / MaxDepth * MAX_uint16), 0, (int32)MAX_uint16);
+}
+
+float FLXRLightOcclusionMap::DecodeDepth(uint16 Encoded) const
+{
+	return (float)Encoded / MAX_uint16 * MaxDepth;
+}
@@ -0,0 +1,57 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXROccluderComponent.h"
+#include "LXRSubsystem.h"
+
+ULXROccluderComponent::ULXROccluderComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void ULXROccluderComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	LXRSubsystem = GetWorld()->GetSubsystem<ULXRSubsystem>();
+	LXRSubsystem->RegisterOccluder(this);
+
+	if (Mobility == EComponentMobility::Movable)
+		TransformUpdated.AddUObject(this, &ULXROccluderComponent::OnOccluderTransformUpdated);
+}
+
+void ULXROccluderComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	TransformUpdated.RemoveAll(this);
+	if (LXRSubsystem)
+		LXRSubsystem->UnregisterOccluder(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ULXROccluderComponent::OnOccluderTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	LXRSubsystem->MarkOccluderMoved(this);
+}
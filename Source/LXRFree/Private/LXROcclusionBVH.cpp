@@ -0,0 +1,234 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXROcclusionBVH.h"
+#include "Algo/Sort.h"
+
+namespace
+{
+	//Few proxies per leaf keep leaves cheap to test and the tree shallow.
+	constexpr int32 MaxLeafProxies = 4;
+
+	FVector3f GetInverseDirection(const FVector3f& Direction)
+	{
+		return FVector3f(
+			FMath::IsNearlyZero(Direction.X) ? BIG_NUMBER : 1.f / Direction.X,
+			FMath::IsNearlyZero(Direction.Y) ? BIG_NUMBER : 1.f / Direction.Y,
+			FMath::IsNearlyZero(Direction.Z) ? BIG_NUMBER : 1.f / Direction.Z);
+	}
+}
+
+void FLXROccluderProxy::UpdateBounds()
+{
+	Bounds = FBox(-Extent, Extent).TransformBy(Transform);
+}
+
+void FLXROcclusionBVH::Build()
+{
+	Nodes.Reset();
+	ProxyIndices.Reset(Proxies.Num());
+	for (int32 i = 0; i < Proxies.Num(); ++i)
+	{
+		ProxyIndices.Add(i);
+	}
+
+	if (Proxies.Num() == 0)
+		return;
+
+	Nodes.Reserve(Proxies.Num() * 2);
+	BuildNode(0, Proxies.Num());
+}
+
+int32 FLXROcclusionBVH::BuildNode(int32 First, int32 Count)
+{
+	FBox Bounds(ForceInit);
+	FBox CentroidBounds(ForceInit);
+	for (int32 i = First; i < First + Count; ++i)
+	{
+		const FBox& ProxyBounds = Proxies[ProxyIndices[i]].Bounds;
+		Bounds += ProxyBounds;
+		CentroidBounds += ProxyBounds.GetCenter();
+	}
+
+	const int32 NodeIndex = Nodes.AddDefaulted();
+	Nodes[NodeIndex].Min = FVector3f(Bounds.Min);
+	Nodes[NodeIndex].Max = FVector3f(Bounds.Max);
+
+	if (Count <= MaxLeafProxies)
+	{
+		Nodes[NodeIndex].FirstOrRight = First;
+		Nodes[NodeIndex].Count = Count;
+		return NodeIndex;
+	}
+
+	//Median split along longest axis of proxy centers.
+	const FVector CentroidSize = CentroidBounds.GetSize();
+	const int32 Axis = CentroidSize.X > CentroidSize.Y ? (CentroidSize.X > CentroidSize.Z ? 0 : 2) : (CentroidSize.Y > CentroidSize.Z ? 1 : 2);
+	Algo::Sort(MakeArrayView(ProxyIndices.GetData() + First, Count), [this, Axis](int32 A, int32 B)
+	{
+		return Proxies[A].Bounds.GetCenter()[Axis] < Proxies[B].Bounds.GetCenter()[Axis];
+	});
+
+	const int32 LeftCount = Count / 2;
+	BuildNode(First, LeftCount);
+	const int32 Right = BuildNode(First + LeftCount, Count - LeftCount);
+
+	Nodes[NodeIndex].FirstOrRight = Right;
+	Nodes[NodeIndex].Count = 0;
+	return NodeIndex;
+}
+
+void FLXROcclusionBVH::Refit()
+{
+	//Children always come after their parent, walking backwards refits children first.
+	for (int32 NodeIndex = Nodes.Num() - 1; NodeIndex >= 0; --NodeIndex)
+	{
+		FNode& Node = Nodes[NodeIndex];
+		FBox Bounds(ForceInit);
+		if (Node.Count > 0)
+		{
+			for (int32 i = Node.FirstOrRight; i < Node.FirstOrRight + Node.Count; ++i)
+			{
+				Bounds += Proxies[ProxyIndices[i]].Bounds;
+			}
+		}
+		else
+		{
+			const FNode& Left = Nodes[NodeIndex + 1];
+			const FNode& Right = Nodes[Node.FirstOrRight];
+			Bounds += FBox(FVector(Left.Min), FVector(Left.Max));
+			Bounds += FBox(FVector(Right.Min), FVector(Right.Max));
+		}
+
+		Node.Min = FVector3f(Bounds.Min);
+		Node.Max = FVector3f(Bounds.Max);
+	}
+}
+
+bool FLXROcclusionBVH::IsBlocked(const FVector& Start, const FVector& End, TConstArrayView<TObjectKey<AActor>> IgnoredOwners) const
+{
+	FLXRBlockedBitArray Blocked;
+	GetBlockedSegments(MakeArrayView(&Start, 1), MakeArrayView(&End, 1), Blocked, IgnoredOwners);
+	return Blocked[0];
+}
+
+void FLXROcclusionBVH::GetBlockedSegments(TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, FLXRBlockedBitArray& OutBlocked, TConstArrayView<TObjectKey<AActor>> IgnoredOwners) const
+{
+	check(Starts.Num() == Ends.Num());
+	OutBlocked.Init(false, Starts.Num());
+	if (IsEmpty())
+		return;
+
+	FPacket Packet;
+	for (int32 PacketFirst = 0; PacketFirst < Starts.Num(); PacketFirst += UE_ARRAY_COUNT(Packet.Starts))
+	{
+		Packet.Num = FMath::Min<int32>(Starts.Num() - PacketFirst, UE_ARRAY_COUNT(Packet.Starts));
+		for (int32 i = 0; i < Packet.Num; ++i)
+		{
+			Packet.Starts[i] = FVector3f(Starts[PacketFirst + i]);
+			Packet.Ends[i] = FVector3f(Ends[PacketFirst + i]);
+			Packet.InverseDirections[i] = GetInverseDirection(Packet.Ends[i] - Packet.Starts[i]);
+		}
+
+		uint64 BlockedMask = 0;
+		TraversePacket(Packet, BlockedMask, IgnoredOwners);
+		for (int32 i = 0; i < Packet.Num; ++i)
+		{
+			if (BlockedMask & (1ull << i))
+				OutBlocked[PacketFirst + i] = true;
+		}
+	}
+}
+
+void FLXROcclusionBVH::TraversePacket(const FPacket& Packet, uint64& InOutBlockedMask, TConstArrayView<TObjectKey<AActor>> IgnoredOwners) const
+{
+	const uint64 PacketMask = Packet.Num == 64 ? ~0ull : (1ull << Packet.Num) - 1;
+
+	int32 Stack[64];
+	int32 StackSize = 0;
+	Stack[StackSize++] = 0;
+
+	while (StackSize > 0)
+	{
+		const int32 NodeIndex = Stack[--StackSize];
+		const FNode& Node = Nodes[NodeIndex];
+
+		//Blocked segments are done, only the rest go down the tree.
+		const uint64 ActiveMask = PacketMask & ~InOutBlockedMask;
+		if (ActiveMask == 0)
+			return;
+
+		uint64 HitMask = 0;
+		for (uint64 Remaining = ActiveMask; Remaining != 0; Remaining &= Remaining - 1)
+		{
+			const int32 i = FMath::CountTrailingZeros64(Remaining);
+			if (SegmentIntersectsBox(Packet.Starts[i], Packet.InverseDirections[i], Node.Min, Node.Max))
+				HitMask |= 1ull << i;
+		}
+
+		if (HitMask == 0)
+			continue;
+
+		if (Node.Count > 0)
+		{
+			for (int32 ProxyIndex = Node.FirstOrRight; ProxyIndex < Node.FirstOrRight + Node.Count; ++ProxyIndex)
+			{
+				const FLXROccluderProxy& Proxy = Proxies[ProxyIndices[ProxyIndex]];
+				if (IgnoredOwners.Contains(Proxy.Owner))
+					continue;
+
+				for (uint64 Remaining = HitMask & ~InOutBlockedMask; Remaining != 0; Remaining &= Remaining - 1)
+				{
+					const int32 i = FMath::CountTrailingZeros64(Remaining);
+					if (SegmentIntersectsProxy(Proxy, FVector(Packet.Starts[i]), FVector(Packet.Ends[i])))
+						InOutBlockedMask |= 1ull << i;
+				}
+			}
+		}
+		else if (StackSize + 2 <= UE_ARRAY_COUNT(Stack))
+		{
+			Stack[StackSize++] = Node.FirstOrRight;
+			Stack[StackSize++] = NodeIndex + 1;
+		}
+	}
+}
+
+bool FLXROcclusionBVH::SegmentIntersectsBox(const FVector3f& Start, const FVector3f& InverseDirection, const FVector3f& Min, const FVector3f& Max)
+{
+	//Slab test, segment is Start + t * Direction for t in 0-1.
+	const FVector3f T1 = (Min - Start) * InverseDirection;
+	const FVector3f T2 = (Max - Start) * InverseDirection;
+	const float TMin = FMath::Max3(FMath::Min(T1.X, T2.X), FMath::Min(T1.Y, T2.Y), FMath::Min(T1.Z, T2.Z));
+	const float TMax = FMath::Min3(FMath::Max(T1.X, T2.X), FMath::Max(T1.Y, T2.Y), FMath::Max(T1.Z, T2.Z));
+	return TMax >= FMath::Max(TMin, 0.f) && TMin <= 1.f;
+}
+
+bool FLXROcclusionBVH::SegmentIntersectsProxy(const FLXROccluderProxy& Proxy, const FVector& Start, const FVector& End)
+{
+	const FVector3f LocalStart = FVector3f(Proxy.Transform.InverseTransformPosition(Start));
+	const FVector3f LocalEnd = FVector3f(Proxy.Transform.InverseTransformPosition(End));
+	const FVector3f Extent = FVector3f(Proxy.Extent);
+	return SegmentIntersectsBox(LocalStart, GetInverseDirection(LocalEnd - LocalStart), -Extent, Extent);
+}
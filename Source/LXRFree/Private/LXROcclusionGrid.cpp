@@ -0,0 +1,174 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXROcclusionGrid.h"
+#include "Components/PrimitiveComponent.h"
+
+namespace
+{
+	FIntVector GetBrick(const FIntVector& Voxel)
+	{
+		return FIntVector(Voxel.X >> 3, Voxel.Y >> 3, Voxel.Z >> 3);
+	}
+
+	uint64 GetBrickBit(const FIntVector& Voxel)
+	{
+		return 1ull << ((Voxel.X & 7) + (Voxel.Y & 7) * 8);
+	}
+}
+
+void FLXROcclusionGrid::Reset(float InVoxelSize)
+{
+	VoxelSize = FMath::Max(InVoxelSize, 1.f);
+	StaticBricks.Reset();
+	OccluderBricks.Reset();
+}
+
+bool FLXROcclusionGrid::AddStaticComponent(const UPrimitiveComponent& Component, int64 MaxVoxels)
+{
+	const FBox Bounds = Component.Bounds.GetBox();
+	const FIntVector Min = GetVoxel(Bounds.Min);
+	const FIntVector Max = GetVoxel(Bounds.Max);
+	const int64 VoxelCount = int64(Max.X - Min.X + 1) * int64(Max.Y - Min.Y + 1) * int64(Max.Z - Min.Z + 1);
+	if (VoxelCount > MaxVoxels)
+		return false;
+
+	const FCollisionShape VoxelShape = FCollisionShape::MakeBox(FVector(VoxelSize * 0.5f));
+	FIntVector Voxel;
+	for (Voxel.Z = Min.Z; Voxel.Z <= Max.Z; ++Voxel.Z)
+	{
+		for (Voxel.Y = Min.Y; Voxel.Y <= Max.Y; ++Voxel.Y)
+		{
+			for (Voxel.X = Min.X; Voxel.X <= Max.X; ++Voxel.X)
+			{
+				if (IsVoxelSet(StaticBricks, Voxel))
+					continue;
+
+				const FVector VoxelCenter = (FVector(Voxel) + 0.5f) * VoxelSize;
+				if (Component.OverlapComponent(VoxelCenter, FQuat::Identity, VoxelShape))
+					SetVoxel(StaticBricks, Voxel);
+			}
+		}
+	}
+	return true;
+}
+
+void FLXROcclusionGrid::ClearOccluders()
+{
+	OccluderBricks.Reset();
+}
+
+void FLXROcclusionGrid::AddOccluderBox(const FBox& Box)
+{
+	const FIntVector Min = GetVoxel(Box.Min);
+	const FIntVector Max = GetVoxel(Box.Max);
+	FIntVector Voxel;
+	for (Voxel.Z = Min.Z; Voxel.Z <= Max.Z; ++Voxel.Z)
+	{
+		for (Voxel.Y = Min.Y; Voxel.Y <= Max.Y; ++Voxel.Y)
+		{
+			for (Voxel.X = Min.X; Voxel.X <= Max.X; ++Voxel.X)
+			{
+				SetVoxel(OccluderBricks, Voxel);
+			}
+		}
+	}
+}
+
+bool FLXROcclusionGrid::IsBlocked(const FVector& Start, const FVector& End) const
+{
+	if (IsEmpty())
+		return false;
+
+	//Everything below is in voxel units.
+	const FVector GridStart = Start / VoxelSize;
+	const FVector Direction = End / VoxelSize - GridStart;
+	FIntVector Voxel = GetVoxel(Start);
+	const FIntVector EndVoxel = GetVoxel(End);
+
+	FIntVector Step;
+	FVector TMax;
+	FVector TDelta;
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		if (Direction[Axis] > 0)
+		{
+			Step[Axis] = 1;
+			TDelta[Axis] = 1.f / Direction[Axis];
+			TMax[Axis] = (Voxel[Axis] + 1 - GridStart[Axis]) * TDelta[Axis];
+		}
+		else if (Direction[Axis] < 0)
+		{
+			Step[Axis] = -1;
+			TDelta[Axis] = -1.f / Direction[Axis];
+			TMax[Axis] = (GridStart[Axis] - Voxel[Axis]) * TDelta[Axis];
+		}
+		else
+		{
+			Step[Axis] = 0;
+			TDelta[Axis] = BIG_NUMBER;
+			TMax[Axis] = BIG_NUMBER;
+		}
+	}
+
+	const int32 MaxSteps = FMath::Abs(EndVoxel.X - Voxel.X) + FMath::Abs(EndVoxel.Y - Voxel.Y) + FMath::Abs(EndVoxel.Z - Voxel.Z);
+	for (int32 StepIndex = 0; StepIndex < MaxSteps; ++StepIndex)
+	{
+		const int32 Axis = TMax.X < TMax.Y ? (TMax.X < TMax.Z ? 0 : 2) : (TMax.Y < TMax.Z ? 1 : 2);
+		if (TMax[Axis] > 1)
+			break;
+
+		Voxel[Axis] += Step[Axis];
+		TMax[Axis] += TDelta[Axis];
+
+		if (Voxel == EndVoxel)
+			break;
+
+		if (IsVoxelSolid(Voxel))
+			return true;
+	}
+	return false;
+}
+
+FIntVector FLXROcclusionGrid::GetVoxel(const FVector& Location) const
+{
+	return FIntVector(FMath::FloorToInt(Location.X / VoxelSize), FMath::FloorToInt(Location.Y / VoxelSize), FMath::FloorToInt(Location.Z / VoxelSize));
+}
+
+bool FLXROcclusionGrid::IsVoxelSolid(const FIntVector& Voxel) const
+{
+	return IsVoxelSet(StaticBricks, Voxel) || IsVoxelSet(OccluderBricks, Voxel);
+}
+
+bool FLXROcclusionGrid::IsVoxelSet(const TMap<FIntVector, FBrick>& Bricks, const FIntVector& Voxel)
+{
+	const FBrick* Brick = Bricks.Find(GetBrick(Voxel));
+	return Brick && (Brick->Bits[Voxel.Z & 7] & GetBrickBit(Voxel)) != 0;
+}
+
+void FLXROcclusionGrid::SetVoxel(TMap<FIntVector, FBrick>& Bricks, const FIntVector& Voxel)
+{
+	Bricks.FindOrAdd(GetBrick(Voxel)).Bits[Voxel.Z & 7] |= GetBrickBit(Voxel);
+}
@@ -26,7 +26,14 @@ SOFTWARE.
 #include "LXRFunctionLibrary.h"
 #include "LXRSubsystem.h"
 #include "Components/DirectionalLightComponent.h"
-#include "Kismet/KismetSystemLibrary.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "WorldCollision.h"
+#if WITH_EDITOR
+#include "UObject/ObjectSaveContext.h"
+#endif
 
 // Sets default values for this component's properties
 ULXRSourceComponent::ULXRSourceComponent()
@@ -43,12 +50,83 @@ ULXRSourceComponent::ULXRSourceComponent()
 	// ...
 }
 
+void ULXRSourceComponent::AddReferencedObjects(UObject* InThis, FReferenceCollector& Collector)
+{
+	//Only strong reference LXR source holds at runtime, other actor lists are weak.
+	ULXRSourceComponent* This = CastChecked<ULXRSourceComponent>(InThis);
+	Collector.AddReferencedObjects(This->ScriptIgnoreVisibilityActors, This);
+	Super::AddReferencedObjects(InThis, Collector);
+}
+
 void ULXRSourceComponent::TickComponent(float DeltaTime, ELevelTick Tick, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, Tick, ThisTickFunction);
 	constexpr float Mpl = 2;
 	const float SpeedPercent = FMath::Abs(FMath::Max(1.f, GetOwner()->GetVelocity().Size()) / 150 - 1) * Mpl;
-	SetComponentTickInterval(FMath::Clamp(SpeedPercent, 0.15f, Mpl));
+	SetComponentTickInterval(DormantListeners > 0 ? 0.15f : FMath::Clamp(SpeedPercent, 0.15f, Mpl));
+
+	const uint32 LightStateHash = CalculateLightStateHash();
+	if (LightStateHash != LastLightStateHash)
+	{
+		LastLightStateHash = LightStateHash;
+		MarkLightChanged();
+	}
+
+	if (!bOverlapQueryQueued && !GetOwner()->GetActorLocation().Equals(OverlapQueryLocation, 1.f))
+		QueueOverlappingActorsQuery();
+}
+
+void ULXRSourceComponent::MarkLightChanged()
+{
+	ChangeGeneration++;
+}
+
+uint32 ULXRSourceComponent::GetChangeGeneration() const
+{
+	return ChangeGeneration;
+}
+
+void ULXRSourceComponent::SetDisabled(bool bNewDisable)
+{
+	if (bDisable == bNewDisable)
+		return;
+
+	bDisable = bNewDisable;
+	MarkLightChanged();
+}
+
+void ULXRSourceComponent::AddDormantListener()
+{
+	//Static lights tick every two seconds, dormant listeners would miss a switched off light that long.
+	if (DormantListeners++ == 0 && PrimaryComponentTick.IsTickFunctionEnabled())
+		SetComponentTickInterval(0.15f);
+}
+
+void ULXRSourceComponent::RemoveDormantListener()
+{
+	DormantListeners = FMath::Max(0, DormantListeners - 1);
+}
+
+uint32 ULXRSourceComponent::CalculateLightStateHash() const
+{
+	uint32 Hash = GetTypeHash(bDisable);
+	for (const ULightComponent* LightComponent : MyLightComponents)
+	{
+		if (!IsValid(LightComponent))
+			continue;
+
+		const FVector Location = LightComponent->GetComponentLocation();
+		const FQuat Rotation = LightComponent->GetComponentQuat();
+		const FLinearColor Color = LightComponent->GetLightColor();
+
+		Hash = FCrc::MemCrc32(&Location, sizeof(FVector), Hash);
+		Hash = FCrc::MemCrc32(&Rotation, sizeof(FQuat), Hash);
+		Hash = FCrc::MemCrc32(&Color, sizeof(FLinearColor), Hash);
+		Hash = HashCombine(Hash, GetTypeHash(LightComponent->Intensity));
+		Hash = HashCombine(Hash, GetTypeHash(LightComponent->Temperature));
+		Hash = HashCombine(Hash, GetTypeHash(IsLightComponentEnabled(LightComponent)));
+	}
+	return Hash;
 }
 
 
@@ -72,6 +150,89 @@ bool ULXRSourceComponent::IsLightComponentEnabled(const ULightComponent* LightCo
 	return LightComponent->IsVisible();
 }
 
+TArray<AActor*> ULXRSourceComponent::GetDetectedActors() const
+{
+	TArray<AActor*> ReturnList;
+	ReturnList.Reserve(DetectedActors.Num());
+	for (const TWeakObjectPtr<AActor>& DetectedActor : DetectedActors)
+	{
+		if (DetectedActor.IsValid())
+			ReturnList.Add(DetectedActor.Get());
+	}
+	return ReturnList;
+}
+
+bool ULXRSourceComponent::IsActorDetected(AActor* Actor) const
+{
+	return DetectedActors.Contains(Actor);
+}
+
+void ULXRSourceComponent::AddDetectedActor(AActor* DetectedActor)
+{
+	bool bAlreadyDetected = false;
+	DetectedActors.Add(DetectedActor, &bAlreadyDetected);
+	if (bAlreadyDetected)
+		return;
+
+	if (PendingUndetectedActors.Remove(DetectedActor) == 0)
+		PendingDetectedActors.Add(DetectedActor);
+	QueueDetectedActorChanges();
+}
+
+void ULXRSourceComponent::RemoveDetectedActor(AActor* DetectedActor)
+{
+	if (DetectedActors.Remove(DetectedActor) == 0)
+		return;
+
+	if (PendingDetectedActors.Remove(DetectedActor) == 0)
+		PendingUndetectedActors.Add(DetectedActor);
+	QueueDetectedActorChanges();
+}
+
+void ULXRSourceComponent::QueueDetectedActorChanges()
+{
+	if (bDetectedActorChangesQueued)
+		return;
+
+	ULXRSubsystem* LightDetectionSubsystem = GetWorld()->GetSubsystem<ULXRSubsystem>();
+	if (IsValid(LightDetectionSubsystem))
+	{
+		bDetectedActorChangesQueued = true;
+		LightDetectionSubsystem->QueueDetectedActorChanges(this);
+	}
+}
+
+void ULXRSourceComponent::FlushDetectedActorChanges()
+{
+	bDetectedActorChangesQueued = false;
+
+	TArray<AActor*> Actors;
+	if (PendingDetectedActors.Num() > 0)
+	{
+		for (const TWeakObjectPtr<AActor>& Actor : PendingDetectedActors)
+		{
+			if (Actor.IsValid())
+				Actors.Add(Actor.Get());
+		}
+		PendingDetectedActors.Reset();
+		if (Actors.Num() > 0)
+			OnDetected.Broadcast(Actors);
+	}
+
+	if (PendingUndetectedActors.Num() > 0)
+	{
+		Actors.Reset();
+		for (const TWeakObjectPtr<AActor>& Actor : PendingUndetectedActors)
+		{
+			if (Actor.IsValid())
+				Actors.Add(Actor.Get());
+		}
+		PendingUndetectedActors.Reset();
+		if (Actors.Num() > 0)
+			OnUndetected.Broadcast(Actors);
+	}
+}
+
 TArray<AActor*> ULXRSourceComponent::GetIgnoreVisibilityActors_Implementation()
 {
 	return IgnoreVisibilityActors;
@@ -137,9 +298,6 @@ FLinearColor ULXRSourceComponent::GetCombinedColorsByComponentIndices(const TArr
 // Called when the game starts
 void ULXRSourceComponent::BeginPlay()
 {
-	TArray<TEnumAsByte<EObjectTypeQuery>> ObjectTypeQueries;
-	ObjectTypeQueries.Add(UEngineTypes::ConvertToObjectType(ECC_WorldStatic));
-	UKismetSystemLibrary::SphereOverlapActors(this, GetOwner()->GetActorLocation(), 30.f, ObjectTypeQueries,NULL, {}, MyOverlappingActors);
 	FindMyLightComponents();
 
 	for (const auto Component : MyLightComponents)
@@ -148,6 +306,10 @@ void ULXRSourceComponent::BeginPlay()
 			bAlwaysRelevant = Component->IsA(UDirectionalLightComponent::StaticClass()) ? true : bAlwaysRelevant;
 	}
 
+	bIgnoreVisibilityActorsInScript = GetClass()->IsFunctionImplementedInScript(GET_FUNCTION_NAME_CHECKED(ULXRSourceComponent, GetIgnoreVisibilityActors));
+
+	LastLightStateHash = CalculateLightStateHash();
+	QueueOverlappingActorsQuery();
 	RegisterLight();
 
 	Super::BeginPlay();
@@ -155,7 +317,21 @@ void ULXRSourceComponent::BeginPlay()
 
 void ULXRSourceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	DeRegisterLight();
+	OcclusionMapsPayload.Cancel();
+	bOcclusionMapsRequested = false;
+	PendingOcclusionMaps.Reset();
+	bOverlapQueryQueued = false;
+	if (!OcclusionMapsPayload.IsEmpty())
+	{
+		for (FLXRLightOcclusionMap& OcclusionMap : OcclusionMaps)
+			OcclusionMap.Depths.Empty();
+	}
+
+	//Streamed out lights of a level are unregistered together once the level is removed.
+	if (EndPlayReason == EEndPlayReason::RemovedFromWorld)
+		QueueDeRegisterLight();
+	else
+		DeRegisterLight();
 	Super::EndPlay(EndPlayReason);
 }
 
@@ -170,7 +346,7 @@ void ULXRSourceComponent::RegisterLight()
 {
 	ULXRSubsystem* LightDetectionSubsystem = GetOwner()->GetWorld()->GetSubsystem<ULXRSubsystem>();
 	if (IsValid(LightDetectionSubsystem))
-		LightDetectionSubsystem->RegisterLight(Cast<AActor>(GetOwner()));
+		LightDetectionSubsystem->QueueLightRegistration(GetOwner());
 
 }
 
@@ -182,26 +358,278 @@ void ULXRSourceComponent::DeRegisterLight() const
 		LightDetectionSubsystem->UnregisterLight(GetOwner());
 }
 
-TArray<AActor*>& ULXRSourceComponent::GetMyOverlappingActors()
+void ULXRSourceComponent::QueueDeRegisterLight() const
+{
+	ULXRSubsystem* LightDetectionSubsystem = GetOwner()->GetWorld()->GetSubsystem<ULXRSubsystem>();
+	if (IsValid(LightDetectionSubsystem))
+		LightDetectionSubsystem->QueueLightUnregistration(GetOwner());
+}
+
+const TArray<TWeakObjectPtr<AActor>>& ULXRSourceComponent::GetMyOverlappingActors() const
 {
 	return MyOverlappingActors;
 }
 
-TArray<ULightComponent*> ULXRSourceComponent::GetMyLightComponents() const
+const TArray<ULightComponent*>& ULXRSourceComponent::GetMyLightComponents() const
 {
 	return MyLightComponents;
 }
 
+TConstArrayView<ULightComponent*> ULXRSourceComponent::GetLightComponentsView() const
+{
+	return MyLightComponents;
+}
+
+void ULXRSourceComponent::BakeOcclusionMaps()
+{
+	if (!GetWorld()->IsGameWorld())
+	{
+		//Called from editor, nothing is gathered before BeginPlay. Baked depths are saved as bulk data with the level.
+		Modify();
+		FindMyOverlappingActors();
+		FindMyLightComponents();
+	}
+
+	OcclusionMaps.Reset();
+	UpdateOcclusionMaps();
+
+	if (!GetWorld()->IsGameWorld())
+	{
+		TArray<uint8> Bytes;
+		FMemoryWriter Ar(Bytes);
+		SerializeOcclusionMapDepths(Ar);
+		OcclusionMapsPayload.Store(Bytes);
+	}
+}
+
+void ULXRSourceComponent::LoadOcclusionMaps()
+{
+	TWeakObjectPtr<ULXRSourceComponent> WeakThis(this);
+	OcclusionMapsPayload.LoadAsync([WeakThis](TArray<uint8>&& Bytes)
+	{
+		ULXRSourceComponent* LightSourceComponent = WeakThis.Get();
+		if (!LightSourceComponent)
+			return;
+
+		if (Bytes.Num() > 0)
+		{
+			FMemoryReader Ar(Bytes);
+			LightSourceComponent->SerializeOcclusionMapDepths(Ar);
+		}
+		LightSourceComponent->UpdateOcclusionMaps();
+	});
+}
+
+void ULXRSourceComponent::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+	OcclusionMapsPayload.Serialize(Ar, this);
+}
+
+void ULXRSourceComponent::SerializeOcclusionMapDepths(FArchive& Ar)
+{
+	int32 MapCount = OcclusionMaps.Num();
+	Ar << MapCount;
+	//Maps were edited after the bake, outdated maps are rebaked.
+	if (MapCount != OcclusionMaps.Num())
+		return;
+
+	for (FLXRLightOcclusionMap& OcclusionMap : OcclusionMaps)
+		Ar << OcclusionMap.Depths;
+}
+
+void ULXRSourceComponent::UpdateOcclusionMaps()
+{
+	OcclusionMaps.SetNum(MyLightComponents.Num());
+	PendingOcclusionMaps.Reset();
+
+	for (int i = 0; i < MyLightComponents.Num(); ++i)
+	{
+		//Maps are never rebaked on their own, light must not move.
+		const ULightComponent* LightComponent = MyLightComponents[i];
+		if (LightComponent->Mobility == EComponentMobility::Movable || OcclusionMaps[i].IsBakedFrom(*LightComponent, OcclusionMapResolution))
+			continue;
+
+		//Outdated map is not sampled while the new one is baked.
+		OcclusionMaps[i] = FLXRLightOcclusionMap();
+
+		FPendingOcclusionMap PendingMap;
+		PendingMap.LightComponentIndex = i;
+		PendingMap.Map = FLXRLightOcclusionMap::Create(*LightComponent, OcclusionMapResolution);
+		if (PendingMap.Map.Type == ELXROcclusionMapType::None)
+			continue;
+
+		PendingOcclusionMaps.Add(MoveTemp(PendingMap));
+	}
+
+	if (PendingOcclusionMaps.Num() == 0)
+		return;
+
+	if (!GetWorld()->IsGameWorld())
+	{
+		int32 TexelBudget = MAX_int32;
+		BakePendingOcclusionMaps(TexelBudget);
+		return;
+	}
+
+	ULXRSubsystem* LightDetectionSubsystem = GetWorld()->GetSubsystem<ULXRSubsystem>();
+	if (LightDetectionSubsystem)
+		LightDetectionSubsystem->QueueOcclusionMapBake(this);
+}
+
+bool ULXRSourceComponent::BakePendingOcclusionMaps(int32& InOutTexelBudget)
+{
+	if (PendingOcclusionMaps.Num() == 0)
+		return true;
+
+	SCOPE_CYCLE_COUNTER(STAT_BakeOcclusionMaps);
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LXRBakeOcclusionMap));
+	QueryParams.AddIgnoredActor(GetOwner());
+	for (const TWeakObjectPtr<AActor>& OverlappingActor : MyOverlappingActors)
+		QueryParams.AddIgnoredActor(OverlappingActor.Get());
+	for (AActor* IgnoredActor : GetVisibilityIgnoredActors())
+		QueryParams.AddIgnoredActor(IgnoredActor);
+
+	while (PendingOcclusionMaps.Num() > 0 && InOutTexelBudget > 0)
+	{
+		FPendingOcclusionMap& PendingMap = PendingOcclusionMaps.Last();
+		const int32 TexelCount = FMath::Min(InOutTexelBudget, PendingMap.Map.GetTexelCount() - PendingMap.NextTexel);
+		PendingMap.Map.BakeTexels(*GetWorld(), PendingMap.NextTexel, TexelCount, QueryParams);
+		PendingMap.NextTexel += TexelCount;
+		InOutTexelBudget -= TexelCount;
+
+		if (PendingMap.NextTexel < PendingMap.Map.GetTexelCount())
+			break;
+
+		if (OcclusionMaps.IsValidIndex(PendingMap.LightComponentIndex))
+			OcclusionMaps[PendingMap.LightComponentIndex] = MoveTemp(PendingMap.Map);
+		PendingOcclusionMaps.Pop(false);
+	}
+
+	return PendingOcclusionMaps.Num() == 0;
+}
+
+const FLXRLightOcclusionMap* ULXRSourceComponent::GetOcclusionMap(int32 LightComponentIndex) const
+{
+	if (!bBakeOcclusionMaps || !OcclusionMaps.IsValidIndex(LightComponentIndex) || !OcclusionMaps[LightComponentIndex].IsValid())
+		return NULL;
+
+	return &OcclusionMaps[LightComponentIndex];
+}
+
+TConstArrayView<AActor*> ULXRSourceComponent::GetVisibilityIgnoredActors()
+{
+	if (!bIgnoreVisibilityActorsInScript)
+		return IgnoreVisibilityActors;
+
+	//Script result is copied once per frame, visibility checks of all detectors read that copy.
+	if (ScriptIgnoreVisibilityActorsFrame != GFrameCounter)
+	{
+		ScriptIgnoreVisibilityActorsFrame = GFrameCounter;
+		ScriptIgnoreVisibilityActors = GetIgnoreVisibilityActors();
+	}
+	return ScriptIgnoreVisibilityActors;
+}
+
+void ULXRSourceComponent::FindMyOverlappingActors()
+{
+	TArray<AActor*> OverlappingActors;
+	GatherOverlappingActors(*GetWorld(), GetOwner()->GetActorLocation(), OverlappingActors);
+	MyOverlappingActors.Reset(OverlappingActors.Num());
+	MyOverlappingActors.Append(OverlappingActors);
+}
+
+void ULXRSourceComponent::GatherOverlappingActors(const UWorld& World, const FVector& Location, TArray<AActor*>& OutOverlappingActors)
+{
+	TArray<FOverlapResult> Overlaps;
+	World.OverlapMultiByObjectType(Overlaps, Location, FQuat::Identity, FCollisionObjectQueryParams(ECC_WorldStatic), FCollisionShape::MakeSphere(30.f), FCollisionQueryParams(SCENE_QUERY_STAT(LXRSourceOverlap)));
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		if (AActor* OverlapActor = Overlap.GetActor())
+			OutOverlappingActors.AddUnique(OverlapActor);
+	}
+}
+
+void ULXRSourceComponent::QueueOverlappingActorsQuery()
+{
+	const FVector Location = GetOwner()->GetActorLocation();
+	if (bHasCachedOverlappingActors && Location.Equals(CachedOverlapLocation, 1.f))
+	{
+		TArray<AActor*> OverlappingActors;
+		for (const TSoftObjectPtr<AActor>& CachedActor : CachedOverlappingActors)
+		{
+			if (AActor* OverlapActor = CachedActor.Get())
+				OverlappingActors.Add(OverlapActor);
+		}
+
+		//Some fixture is in a cell that is not loaded, query instead.
+		if (OverlappingActors.Num() == CachedOverlappingActors.Num())
+		{
+			SetOverlappingActors(OverlappingActors, Location);
+			return;
+		}
+	}
+
+	ULXRSubsystem* LightDetectionSubsystem = GetWorld()->GetSubsystem<ULXRSubsystem>();
+	if (IsValid(LightDetectionSubsystem))
+	{
+		bOverlapQueryQueued = true;
+		LightDetectionSubsystem->QueueOverlappingActorsQuery(this);
+	}
+}
+
+void ULXRSourceComponent::SetOverlappingActors(TConstArrayView<AActor*> OverlappingActors, const FVector& QueryLocation)
+{
+	MyOverlappingActors.Reset(OverlappingActors.Num());
+	for (AActor* OverlapActor : OverlappingActors)
+		MyOverlappingActors.Add(OverlapActor);
+
+	OverlapQueryLocation = QueryLocation;
+	bOverlapQueryQueued = false;
+
+	if (bBakeOcclusionMaps && !bOcclusionMapsRequested)
+	{
+		bOcclusionMapsRequested = true;
+		LoadOcclusionMaps();
+	}
+}
+
+#if WITH_EDITOR
+void ULXRSourceComponent::PreSave(FObjectPreSaveContext SaveContext)
+{
+	Super::PreSave(SaveContext);
+
+	bHasCachedOverlappingActors = false;
+	CachedOverlappingActors.Reset();
+
+	UWorld* World = GetWorld();
+	if (!bCacheOverlappingActors || !GetOwner() || !World || !World->GetPhysicsScene())
+		return;
+
+	CachedOverlapLocation = GetOwner()->GetActorLocation();
+	TArray<AActor*> OverlappingActors;
+	GatherOverlappingActors(*World, CachedOverlapLocation, OverlappingActors);
+	for (AActor* OverlapActor : OverlappingActors)
+		CachedOverlappingActors.Add(OverlapActor);
+	bHasCachedOverlappingActors = true;
+}
+#endif
+
 void ULXRSourceComponent::FindMyLightComponents()
 {
-	GetOwner()->GetComponents<ULightComponent>(MyLightComponents);
+	GetLightComponents(MyLightComponents);
+}
+
+void ULXRSourceComponent::GetLightComponents(TArray<ULightComponent*>& OutLightComponents) const
+{
+	GetOwner()->GetComponents<ULightComponent>(OutLightComponents);
 	for (FComponentReference ExcludedLightComponent : ExcludedLights)
 	{
-		for (int i = MyLightComponents.Num() - 1; i >= 0; --i)
+		for (int i = OutLightComponents.Num() - 1; i >= 0; --i)
 		{
-			if (MyLightComponents[i] == ExcludedLightComponent.GetComponent(GetOwner()))
+			if (OutLightComponents[i] == ExcludedLightComponent.GetComponent(GetOwner()))
 			{
-				MyLightComponents.RemoveAt(i);
+				OutLightComponents.RemoveAt(i);
 			}
 		}
 	}
@@ -27,25 +27,269 @@ SOFTWARE.
 #include "EngineUtils.h"
 #include "LXRFree.h"
 #include "LXRSourceComponent.h"
+#include "LXRDetectionComponent.h"
+#include "LXRSettings.h"
+#include "LXROccluderComponent.h"
+#include "LXRLightGrid.h"
+#include "GameFramework/PlayerController.h"
+#include "Async/ParallelFor.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/DirectionalLightComponent.h"
+#include "Engine/LevelBounds.h"
 DEFINE_LOG_CATEGORY(LogLightSystem);
 
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkVisibilityBackendsCommand(
+	TEXT("LXR.BenchmarkVisibilityBackends"),
+	TEXT("Compares LXR visibility backends on the same rays of the current scene. Optional argument is max ray count, default 10000."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		ULXRSubsystem* LXRSubsystem = World ? World->GetSubsystem<ULXRSubsystem>() : NULL;
+		if (LXRSubsystem)
+			LXRSubsystem->BenchmarkVisibilityBackends(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000);
+	}));
 
-void ULXRSubsystem::RegisterLight(AActor* LightSource)
+namespace
+{
+	void SetOccluderProxy(const ULXROccluderComponent& Occluder, FLXROccluderProxy& Proxy)
+	{
+		Proxy.Transform = Occluder.GetComponentTransform();
+		Proxy.Extent = Occluder.BoxExtent;
+		Proxy.Owner = Occluder.GetOwner();
+		Proxy.UpdateBounds();
+	}
+}
+
+void ULXRSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &ULXRSubsystem::OnLevelAddedToWorld);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &ULXRSubsystem::OnLevelRemovedFromWorld);
+}
+
+void ULXRSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	Super::Deinitialize();
+}
+
+void ULXRSubsystem::Tick(float DeltaTime)
 {
-	const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSource->GetComponentByClass(ULXRSourceComponent::StaticClass()));
-	if (LightSourceComponent->bSolo)
-		bSoloFound = true;
+	Super::Tick(DeltaTime);
+	SCOPE_CYCLE_COUNTER(STAT_SubsystemTick);
+
+	FlushLightRegistrations();
+
+	UpdateOcclusionBVH();
+	if (bOcclusionGridRequested && !bOcclusionGridBuilt)
+		BuildOcclusionGrid();
+	UpdateOcclusionGridOccluders();
+	UpdateSunHeightField();
+	UpdateOcclusionMapBakes();
+
+	if (FrameSnapshotUsers > 0)
+		PublishFrameSnapshot();
+
+	if (IsTraceBudgetEnabled())
+		ServeDetectorsByPriority();
 
-	LightSources.AddUnique(LightSource);
-	OnLightAdded.Broadcast(LightSource);
+	TraceQueuedVisibilityRays();
+	FlushDetectedActorChanges();
+}
+
+TStatId ULXRSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULXRSubsystem, STATGROUP_LXR);
+}
+
+
+void ULXRSubsystem::RegisterLight(AActor* LightSource)
+{
+	RegisterLights(MakeArrayView(&LightSource, 1));
 }
 
 void ULXRSubsystem::UnregisterLight(AActor* LightSource)
 {
-	if (LightSources.Contains(LightSource))
+	UnregisterLights(MakeArrayView(&LightSource, 1));
+}
+
+void ULXRSubsystem::RegisterLights(TConstArrayView<AActor*> NewLightSources)
+{
+	SCOPE_CYCLE_COUNTER(STAT_RegisterLights);
+	const int32 FirstAdded = LightSources.Num();
+	for (AActor* LightSource : NewLightSources)
+	{
+		if (!IsValid(LightSource))
+			continue;
+
+		bool bAlreadyRegistered;
+		LightSourceSet.Add(LightSource, &bAlreadyRegistered);
+		if (bAlreadyRegistered)
+			continue;
+
+		const ULXRSourceComponent* LightSourceComponent = Cast<ULXRSourceComponent>(LightSource->GetComponentByClass(ULXRSourceComponent::StaticClass()));
+		if (LightSourceComponent && LightSourceComponent->bSolo)
+			bSoloFound = true;
+
+		LightSources.Add(LightSource);
+	}
+
+	if (LightSources.Num() == FirstAdded)
+		return;
+
+	LightsVersion++;
+	//Baked lights of a grid can stream in after the grid, listeners must see them as grid lights.
+	if (LightGrids.Num() > 0)
+		UpdateLightGridLights();
+
+	//Copied, listeners may register more lights.
+	const TArray<TWeakObjectPtr<AActor>> AddedLights(MakeArrayView(LightSources).Slice(FirstAdded, LightSources.Num() - FirstAdded));
+	for (const TWeakObjectPtr<AActor>& AddedLight : AddedLights)
+		OnLightAdded.Broadcast(AddedLight.Get());
+	OnLightsAdded.Broadcast(AddedLights);
+}
+
+void ULXRSubsystem::UnregisterLights(TConstArrayView<AActor*> RemovedLightSources)
+{
+	TArray<TWeakObjectPtr<AActor>> LightSourcesToRemove;
+	LightSourcesToRemove.Reserve(RemovedLightSources.Num());
+	for (AActor* LightSource : RemovedLightSources)
+		LightSourcesToRemove.Add(LightSource);
+
+	RemoveRegisteredLights(LightSourcesToRemove);
+}
+
+void ULXRSubsystem::RemoveRegisteredLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSourcesToRemove)
+{
+	SCOPE_CYCLE_COUNTER(STAT_RegisterLights);
+	TArray<TWeakObjectPtr<AActor>> RemovedLights;
+	for (const TWeakObjectPtr<AActor>& LightSource : LightSourcesToRemove)
+	{
+		if (LightSourceSet.Remove(LightSource) > 0)
+			RemovedLights.Add(LightSource);
+	}
+
+	if (RemovedLights.Num() == 0)
+		return;
+
+	//Light order is kept, detection components walk the list with cursors.
+	LightSources.RemoveAll([this](const TWeakObjectPtr<AActor>& LightSource) { return !LightSourceSet.Contains(LightSource); });
+	LightsVersion++;
+	for (const TWeakObjectPtr<AActor>& RemovedLight : RemovedLights)
+		OnLightRemoved.Broadcast(RemovedLight.Get());
+	OnLightsRemoved.Broadcast(RemovedLights);
+}
+
+void ULXRSubsystem::QueueLightRegistration(AActor* LightSource)
+{
+	PendingLightRegistrations.Add(LightSource);
+}
+
+void ULXRSubsystem::QueueLightUnregistration(AActor* LightSource)
+{
+	//Light that ends play before its registration is flushed is never registered.
+	PendingLightRegistrations.RemoveSwap(LightSource);
+	PendingLightUnregistrations.Add(LightSource);
+}
+
+void ULXRSubsystem::QueueOverlappingActorsQuery(ULXRSourceComponent* LightSourceComponent)
+{
+	PendingOverlapQueries.Add(LightSourceComponent);
+}
+
+void ULXRSubsystem::QueueOcclusionMapBake(ULXRSourceComponent* LightSourceComponent)
+{
+	OcclusionMapBakes.AddUnique(LightSourceComponent);
+}
+
+void ULXRSubsystem::UpdateOcclusionMapBakes()
+{
+	int32 TexelBudget = GetDefault<ULXRSettings>()->OcclusionMapTexelsPerFrame;
+	while (OcclusionMapBakes.Num() > 0 && TexelBudget > 0)
+	{
+		//Source returns false only when budget ran out, it continues from the same texel next frame.
+		ULXRSourceComponent* LightSourceComponent = OcclusionMapBakes[0].Get();
+		if (LightSourceComponent && !LightSourceComponent->BakePendingOcclusionMaps(TexelBudget))
+			break;
+
+		OcclusionMapBakes.RemoveAt(0, 1, false);
+	}
+}
+
+void ULXRSubsystem::RunOverlappingActorsQueries()
+{
+	if (PendingOverlapQueries.Num() == 0)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_OverlappingActorsQueries);
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> Queries = MoveTemp(PendingOverlapQueries);
+	PendingOverlapQueries.Reset();
+	Queries.RemoveAll([](const TWeakObjectPtr<ULXRSourceComponent>& Query) { return !Query.IsValid() || !IsValid(Query->GetOwner()); });
+
+	TArray<FVector> Locations;
+	Locations.Reserve(Queries.Num());
+	for (const TWeakObjectPtr<ULXRSourceComponent>& Query : Queries)
+		Locations.Add(Query->GetOwner()->GetActorLocation());
+
+	TArray<TArray<AActor*>> Results;
+	Results.SetNum(Queries.Num());
+	const UWorld& World = *GetWorld();
+	ParallelFor(Queries.Num(), [&](int32 Index)
+	{
+		ULXRSourceComponent::GatherOverlappingActors(World, Locations[Index], Results[Index]);
+	});
+
+	for (int i = 0; i < Queries.Num(); ++i)
+		Queries[i]->SetOverlappingActors(Results[i], Locations[i]);
+}
+
+void ULXRSubsystem::FlushLightRegistrations()
+{
+	//Lights are registered with their fixture meshes known.
+	RunOverlappingActorsQueries();
+
+	if (PendingLightUnregistrations.Num() > 0)
+	{
+		const TArray<TWeakObjectPtr<AActor>> Unregistrations = MoveTemp(PendingLightUnregistrations);
+		PendingLightUnregistrations.Reset();
+		RemoveRegisteredLights(Unregistrations);
+	}
+
+	if (PendingLightRegistrations.Num() > 0)
+	{
+		TArray<AActor*> Registrations;
+		Registrations.Reserve(PendingLightRegistrations.Num());
+		for (const TWeakObjectPtr<AActor>& LightSource : PendingLightRegistrations)
+		{
+			if (LightSource.IsValid())
+				Registrations.Add(LightSource.Get());
+		}
+		PendingLightRegistrations.Reset();
+		RegisterLights(Registrations);
+	}
+}
+
+void ULXRSubsystem::OnLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	//Sources of the level have begun play by now.
+	if (World == GetWorld())
 	{
-		LightSources.Remove(LightSource);
-		OnLightRemoved.Broadcast(LightSource);
+		FlushLightRegistrations();
+		bSunHeightFieldDirty = true;
+		//Static layer is rebuilt with the geometry of the new level on next tick, several levels streaming in one frame share a rebuild.
+		bOcclusionGridBuilt = false;
+	}
+}
+
+void ULXRSubsystem::OnLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+	//Sources of the level have ended play by now.
+	if (World == GetWorld())
+	{
+		FlushLightRegistrations();
+		bSunHeightFieldDirty = true;
+		//Voxels of the removed level must stop blocking light.
+		bOcclusionGridBuilt = false;
 	}
 }
 
@@ -54,3 +298,656 @@ const TArray<TWeakObjectPtr<AActor>>& ULXRSubsystem::GetAllLights() const
 	return LightSources;
 }
 
+TConstArrayView<TWeakObjectPtr<AActor>> ULXRSubsystem::GetAllLightsView() const
+{
+	return LightSources;
+}
+
+
+void ULXRSubsystem::QueueDetectedActorChanges(ULXRSourceComponent* LightSourceComponent)
+{
+	SourcesWithDetectedActorChanges.Add(LightSourceComponent);
+}
+
+void ULXRSubsystem::FlushDetectedActorChanges()
+{
+	//Broadcasts can change detected actors again, those are queued for next frame.
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> SourcesToFlush = MoveTemp(SourcesWithDetectedActorChanges);
+	SourcesWithDetectedActorChanges.Reset();
+	for (const TWeakObjectPtr<ULXRSourceComponent>& LightSourceComponent : SourcesToFlush)
+	{
+		if (LightSourceComponent.IsValid())
+			LightSourceComponent->FlushDetectedActorChanges();
+	}
+}
+
+const FLXRFrameSnapshot& ULXRSubsystem::GetFrameSnapshot() const
+{
+	return FrameSnapshots[ReadFrameSnapshotIndex];
+}
+
+void ULXRSubsystem::AddFrameSnapshotReader(const UE::Tasks::FTask& Task)
+{
+	FrameSnapshotReaders[ReadFrameSnapshotIndex].Add(Task);
+}
+
+void ULXRSubsystem::AddFrameSnapshotUser()
+{
+	FrameSnapshotUsers++;
+}
+
+void ULXRSubsystem::RemoveFrameSnapshotUser()
+{
+	FrameSnapshotUsers = FMath::Max(FrameSnapshotUsers - 1, 0);
+}
+
+void ULXRSubsystem::PublishFrameSnapshot()
+{
+	SCOPE_CYCLE_COUNTER(STAT_PublishFrameSnapshot);
+
+	const int32 WriteFrameSnapshotIndex = 1 - ReadFrameSnapshotIndex;
+	//Readers usually finished long ago, this only blocks if a task is still reading the buffer.
+	UE::Tasks::Wait(FrameSnapshotReaders[WriteFrameSnapshotIndex]);
+	FrameSnapshotReaders[WriteFrameSnapshotIndex].Reset();
+
+	FLXRFrameSnapshot& Snapshot = FrameSnapshots[WriteFrameSnapshotIndex];
+	Snapshot.Reset();
+	Snapshot.Version = FrameSnapshots[ReadFrameSnapshotIndex].Version + 1;
+	Snapshot.Time = GetWorld()->GetTimeSeconds();
+	Snapshot.bSoloFound = bSoloFound;
+
+	//Pipelined culling only looks up lights its detection component has a pair with, other lights are left out.
+	//Pairs hold their source component, so no component lookup is done per light.
+	for (const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent : Detectors)
+	{
+		if (!DetectionComponent.IsValid() || DetectionComponent->RelevantTraceType != ERelevantTraceType::Pipelined)
+			continue;
+
+		Snapshot.AddDetector(*DetectionComponent);
+		for (const FLXRLightPair& LightPair : DetectionComponent->LightPairs)
+		{
+			const ULXRSourceComponent* LightSourceComponent = LightPair.LightSourceComponent.Get();
+			if (IsValid(LightSourceComponent) && !Snapshot.LightIndices.Contains(LightPair.LightSourceOwnerKey))
+				Snapshot.AddLight(*LightSourceComponent);
+		}
+	}
+
+	ReadFrameSnapshotIndex = WriteFrameSnapshotIndex;
+}
+
+int32 ULXRSubsystem::AddVisibilityQueryParams(const FCollisionQueryParams& QueryParams)
+{
+	return VisibilityQueryParams.Add(QueryParams);
+}
+
+void ULXRSubsystem::QueueVisibilityRay(const FLXRVisibilityRay& Ray)
+{
+	VisibilityRays.Add(Ray);
+}
+
+void ULXRSubsystem::RequestParallelVisibilityResults(ULXRDetectionComponent* DetectionComponent)
+{
+	ParallelVisibilityDetectors.Add(DetectionComponent);
+}
+
+void ULXRSubsystem::TraceQueuedVisibilityRays()
+{
+	if (ParallelVisibilityDetectors.Num() == 0)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_ParallelVisibilityTraces);
+
+	VisibilityRayResults.SetNumUninitialized(VisibilityRays.Num());
+	//Scene queries, occluder BVH and occlusion grid are read only here, every ray writes only its own result.
+	ParallelFor(VisibilityRays.Num(), [this](int32 RayIndex)
+	{
+		VisibilityRayResults[RayIndex] = !IsVisibilityBlocked(VisibilityRays[RayIndex]);
+	});
+	INC_DWORD_STAT_BY(STAT_TRACESMULTITHREAD, VisibilityRays.Num());
+
+	for (const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent : ParallelVisibilityDetectors)
+	{
+		if (DetectionComponent.IsValid())
+			DetectionComponent->ApplyParallelRelevantChecks(VisibilityRayResults);
+	}
+
+	ParallelVisibilityDetectors.Reset();
+	VisibilityRays.Reset();
+	VisibilityQueryParams.Reset();
+}
+
+bool ULXRSubsystem::IsVisibilityBlocked(const FLXRVisibilityRay& Ray) const
+{
+	FLXRVisibilityQuery Query;
+	Query.TraceChannel = Ray.TraceChannel;
+	Query.QueryParams = VisibilityQueryParams.IsValidIndex(Ray.QueryParamsIndex) ? &VisibilityQueryParams[Ray.QueryParamsIndex] : NULL;
+	Query.IgnoredOwners = Ray.IgnoredOwners;
+	return GetVisibilityBackend(Ray.Backend).IsBlocked(*GetWorld(), Ray.Start, Ray.End, Query);
+}
+
+ELXRVisibilityBackend ULXRSubsystem::ResolveVisibilityBackend(ELXRVisibilityBackend Backend) const
+{
+	if (Backend == ELXRVisibilityBackend::ProjectDefault)
+		Backend = GetDefault<ULXRSettings>()->DefaultVisibilityBackend;
+
+	return Backend == ELXRVisibilityBackend::ProjectDefault ? ELXRVisibilityBackend::Physics : Backend;
+}
+
+const ILXRVisibilityBackend& ULXRSubsystem::GetVisibilityBackend(ELXRVisibilityBackend Backend) const
+{
+	switch (ResolveVisibilityBackend(Backend))
+	{
+		case ELXRVisibilityBackend::OccluderBVH:
+			return OccluderBVHVisibilityBackend;
+		case ELXRVisibilityBackend::OcclusionGrid:
+			return OcclusionGridVisibilityBackend;
+		case ELXRVisibilityBackend::AlwaysVisible:
+			return AlwaysVisibleBackend;
+		case ELXRVisibilityBackend::Custom:
+			if (CustomVisibilityBackend.IsValid())
+				return *CustomVisibilityBackend;
+			return PhysicsVisibilityBackend;
+		default:
+			return PhysicsVisibilityBackend;
+	}
+}
+
+void ULXRSubsystem::SetCustomVisibilityBackend(TSharedPtr<ILXRVisibilityBackend> Backend)
+{
+	CustomVisibilityBackend = Backend;
+}
+
+void ULXRSubsystem::BenchmarkVisibilityBackends(int32 MaxRays)
+{
+	//Rays from every detection component trace target to every light component.
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+	FLXRTraceTargetArray TraceTargets;
+	for (const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent : Detectors)
+	{
+		if (!DetectionComponent.IsValid())
+			continue;
+
+		DetectionComponent->GetTraceTargets(true, TraceTargets);
+		for (const TWeakObjectPtr<AActor>& LightSource : LightSources)
+		{
+			const ULXRSourceComponent* LightSourceComponent = LightSource.IsValid() ? Cast<ULXRSourceComponent>(LightSource->GetComponentByClass(ULXRSourceComponent::StaticClass())) : NULL;
+			if (!IsValid(LightSourceComponent))
+				continue;
+
+			for (const ULightComponent* LightComponent : LightSourceComponent->GetLightComponentsView())
+			{
+				if (!IsValid(LightComponent))
+					continue;
+
+				for (const FVector& TraceTarget : TraceTargets)
+				{
+					if (Starts.Num() >= MaxRays)
+						break;
+
+					Starts.Add(TraceTarget);
+					Ends.Add(DetectionComponent->GetVisibilityTraceEnd(*LightComponent, TraceTarget));
+				}
+			}
+		}
+	}
+
+	if (Starts.Num() == 0)
+	{
+		UE_LOG(LogLightSystem, Warning, TEXT("LXR visibility benchmark: no detection components or lights"));
+		return;
+	}
+
+	if (!bOcclusionGridBuilt)
+	{
+		BuildOcclusionGrid();
+		UpdateOcclusionGridOccluders();
+	}
+
+	const ELXRVisibilityBackend Backends[] = {ELXRVisibilityBackend::Physics, ELXRVisibilityBackend::OccluderBVH, ELXRVisibilityBackend::OcclusionGrid, ELXRVisibilityBackend::AlwaysVisible, ELXRVisibilityBackend::Custom};
+	const UEnum* BackendEnum = StaticEnum<ELXRVisibilityBackend>();
+	const FLXRVisibilityQuery Query;
+	FLXRBlockedBitArray PhysicsBlocked;
+	FLXRBlockedBitArray Blocked;
+	for (const ELXRVisibilityBackend Backend : Backends)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		GetVisibilityBackend(Backend).GetBlockedSegments(*GetWorld(), Starts, Ends, Query, Blocked);
+		const double Milliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+		if (Backend == ELXRVisibilityBackend::Physics)
+			PhysicsBlocked = Blocked;
+
+		int32 Agreeing = 0;
+		for (int32 i = 0; i < Blocked.Num(); ++i)
+		{
+			if (Blocked[i] == PhysicsBlocked[i])
+				Agreeing++;
+		}
+
+		UE_LOG(LogLightSystem, Log, TEXT("LXR visibility benchmark %s: %d rays, %.3f ms, %.3f us per ray, %.1f%% agree with Physics"),
+			*BackendEnum->GetDisplayNameTextByValue(static_cast<int64>(Backend)).ToString(), Starts.Num(), Milliseconds, Milliseconds * 1000.0 / Starts.Num(), 100.0 * Agreeing / Starts.Num());
+	}
+}
+
+void ULXRSubsystem::RegisterDetector(ULXRDetectionComponent* DetectionComponent)
+{
+	Detectors.AddUnique(DetectionComponent);
+}
+
+void ULXRSubsystem::UnregisterDetector(ULXRDetectionComponent* DetectionComponent)
+{
+	Detectors.RemoveSwap(DetectionComponent);
+}
+
+void ULXRSubsystem::NotifyOccluderChanged(const FBox& OccluderBounds)
+{
+	for (const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent : Detectors)
+	{
+		if (DetectionComponent.IsValid() && DetectionComponent->IsDormant() && DetectionComponent->DormancyArea.Intersect(OccluderBounds))
+			DetectionComponent->WakeUp();
+	}
+}
+
+void ULXRSubsystem::RegisterOccluder(ULXROccluderComponent* Occluder)
+{
+	Occluders.AddUnique(Occluder);
+	bOccludersChanged = true;
+	bOcclusionGridOccludersDirty = true;
+}
+
+void ULXRSubsystem::UnregisterOccluder(ULXROccluderComponent* Occluder)
+{
+	Occluders.RemoveSwap(Occluder);
+	Occluder->OccluderProxyIndex = INDEX_NONE;
+	bOccludersChanged = true;
+	bOcclusionGridOccludersDirty = true;
+}
+
+void ULXRSubsystem::MarkOccluderMoved(ULXROccluderComponent* Occluder)
+{
+	MovedOccluders.AddUnique(Occluder);
+	bOcclusionGridOccludersDirty = true;
+}
+
+void ULXRSubsystem::RequestOcclusionGrid()
+{
+	bOcclusionGridRequested = true;
+}
+
+void ULXRSubsystem::BuildOcclusionGrid()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildOcclusionGrid);
+
+	const ULXRSettings* Settings = GetDefault<ULXRSettings>();
+	OcclusionGrid.Reset(Settings->OcclusionVoxelSize);
+
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		It->ForEachComponent<UPrimitiveComponent>(false, [this, Settings](const UPrimitiveComponent* Component)
+		{
+			if (!Component->IsRegistered() || Component->Mobility != EComponentMobility::Static || !Component->IsQueryCollisionEnabled())
+				return;
+
+			if (Component->GetCollisionResponseToChannel(Settings->OcclusionGridChannel) != ECR_Block)
+				return;
+
+			if (!OcclusionGrid.AddStaticComponent(*Component, Settings->MaxVoxelsPerComponent))
+				UE_LOG(LogLightSystem, Verbose, TEXT("%s is too large for LXR occlusion grid, skipped"), *Component->GetReadableName());
+		});
+	}
+
+	bOcclusionGridBuilt = true;
+	bOcclusionGridOccludersDirty = true;
+	UE_LOG(LogLightSystem, Log, TEXT("LXR occlusion grid built with %d bricks"), OcclusionGrid.GetBrickCount());
+}
+
+void ULXRSubsystem::UpdateOcclusionGridOccluders()
+{
+	if (!bOcclusionGridBuilt || !bOcclusionGridOccludersDirty)
+		return;
+
+	//Proxy bounds are current, BVH was updated first.
+	OcclusionGrid.ClearOccluders();
+	for (const FLXROccluderProxy& Proxy : OcclusionBVH.Proxies)
+	{
+		OcclusionGrid.AddOccluderBox(Proxy.Bounds);
+	}
+	bOcclusionGridOccludersDirty = false;
+}
+
+void ULXRSubsystem::RegisterLightGrid(ALXRLightGrid* LightGrid)
+{
+	LightGrids.AddUnique(LightGrid);
+	UpdateLightGridLights();
+}
+
+void ULXRSubsystem::UnregisterLightGrid(ALXRLightGrid* LightGrid)
+{
+	LightGrids.Remove(LightGrid);
+	UpdateLightGridLights();
+}
+
+void ULXRSubsystem::UpdateLightGridLights()
+{
+	LightGrids.RemoveAll([](const TWeakObjectPtr<ALXRLightGrid>& LightGrid) { return !LightGrid.IsValid(); });
+
+	LightGridLights.Reset();
+	for (const TWeakObjectPtr<ALXRLightGrid>& LightGrid : LightGrids)
+	{
+		for (const TSoftObjectPtr<AActor>& Light : LightGrid->GetBakedLights())
+		{
+			if (const AActor* LoadedLight = Light.Get())
+				LightGridLights.Add(LoadedLight);
+		}
+	}
+}
+
+void ULXRSubsystem::GetLightGridLights(const FVector& Location, TArray<AActor*>& OutLights) const
+{
+	for (const TWeakObjectPtr<ALXRLightGrid>& LightGrid : LightGrids)
+	{
+		if (LightGrid.IsValid())
+			LightGrid->GetCellLights(Location, OutLights);
+	}
+}
+
+void ULXRSubsystem::UpdateSunHeightField()
+{
+	const ULXRSettings* Settings = GetDefault<ULXRSettings>();
+	if (!Settings->bUseSunHeightField)
+		return;
+
+	if (SunLightsVersion != LightsVersion)
+	{
+		//Sun is the first directional light of a registered light source.
+		SunLightsVersion = LightsVersion;
+		SunLight.Reset();
+		for (const TWeakObjectPtr<AActor>& LightSource : LightSources)
+		{
+			const ULXRSourceComponent* LightSourceComponent = LightSource.IsValid() ? Cast<ULXRSourceComponent>(LightSource->GetComponentByClass(ULXRSourceComponent::StaticClass())) : NULL;
+			if (!LightSourceComponent)
+				continue;
+
+			for (ULightComponent* LightComponent : LightSourceComponent->GetMyLightComponents())
+			{
+				if (LightComponent && LightComponent->IsA(UDirectionalLightComponent::StaticClass()))
+				{
+					SunLight = LightComponent;
+					break;
+				}
+			}
+
+			if (SunLight.IsValid())
+				break;
+		}
+	}
+
+	if (!SunLight.IsValid())
+	{
+		SunDirection = FVector::ZeroVector;
+		return;
+	}
+
+	SunDirection = -SunLight->GetForwardVector();
+
+	//Rows already traced may miss geometry of a level streamed in or out since, build starts over.
+	if (bSunHeightFieldDirty)
+		NextSunHeightFieldRow = INDEX_NONE;
+
+	//Start a rebuild once sun has rotated past tolerance, sampled field stays in use until rebuilt one is swapped in.
+	const FLXRSunHeightField& ReadField = SunHeightFields[ReadSunHeightFieldIndex];
+	const float RebuildCos = FMath::Cos(FMath::DegreesToRadians(Settings->SunHeightFieldRebuildAngle));
+	if (NextSunHeightFieldRow == INDEX_NONE && (bSunHeightFieldDirty || ReadField.IsEmpty() || (ReadField.GetSunDirection() | SunDirection) < RebuildCos))
+	{
+		bSunHeightFieldDirty = false;
+		FBox WorldBounds(ForceInit);
+		for (const ULevel* Level : GetWorld()->GetLevels())
+		{
+			if (Level && Level->bIsVisible)
+				WorldBounds += ALevelBounds::CalculateLevelBounds(Level);
+		}
+
+		if (!WorldBounds.IsValid)
+			return;
+
+		SunHeightFields[1 - ReadSunHeightFieldIndex].Reset(SunDirection, WorldBounds, Settings->SunHeightFieldCellSize, Settings->SunHeightFieldMaxResolution);
+		NextSunHeightFieldRow = 0;
+	}
+
+	if (NextSunHeightFieldRow == INDEX_NONE)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_BuildSunHeightField);
+	FLXRSunHeightField& BuildField = SunHeightFields[1 - ReadSunHeightFieldIndex];
+	const int32 FirstRow = NextSunHeightFieldRow;
+	const int32 RowCount = FMath::Min(Settings->SunHeightFieldRowsPerFrame, BuildField.GetRowCount() - FirstRow);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LXRSunHeightField));
+	const UWorld& World = *GetWorld();
+	ParallelFor(RowCount, [&](int32 Index)
+	{
+		BuildField.BuildRow(World, FirstRow + Index, QueryParams);
+	});
+
+	NextSunHeightFieldRow += RowCount;
+	if (NextSunHeightFieldRow >= BuildField.GetRowCount())
+	{
+		ReadSunHeightFieldIndex = 1 - ReadSunHeightFieldIndex;
+		NextSunHeightFieldRow = INDEX_NONE;
+	}
+}
+
+bool ULXRSubsystem::SampleSunVisibility(const ULightComponent& LightComponent, const FVector& Point, bool& OutVisible) const
+{
+	if (SunLight.Get() != &LightComponent)
+		return false;
+
+	const ULXRSettings* Settings = GetDefault<ULXRSettings>();
+	const FLXRSunHeightField& ReadField = SunHeightFields[ReadSunHeightFieldIndex];
+	if (ReadField.IsEmpty() || (ReadField.GetSunDirection() | SunDirection) < FMath::Cos(FMath::DegreesToRadians(Settings->SunHeightFieldRebuildAngle)))
+		return false;
+
+	if (!ReadField.Sample(Point, Settings->SunHeightFieldBias, OutVisible))
+		return false;
+
+	INC_DWORD_STAT(STAT_SUNHEIGHTFIELDSAMPLES);
+	return true;
+}
+
+void ULXRSubsystem::UpdateOcclusionBVH()
+{
+	if (!bOccludersChanged && MovedOccluders.Num() == 0)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_UpdateOcclusionBVH);
+
+	if (bOccludersChanged)
+	{
+		//Dormant detection components near added, removed or moved occluders are woken up, old proxies tell what changed.
+		TArray<FLXROccluderProxy> OldProxies = MoveTemp(OcclusionBVH.Proxies);
+		TBitArray<> KeptOldProxies(false, OldProxies.Num());
+		OcclusionBVH.Proxies.Reset(Occluders.Num());
+		for (const TWeakObjectPtr<ULXROccluderComponent>& Occluder : Occluders)
+		{
+			if (!Occluder.IsValid())
+				continue;
+
+			const int32 OldProxyIndex = Occluder->OccluderProxyIndex;
+			Occluder->OccluderProxyIndex = OcclusionBVH.Proxies.Num();
+			FLXROccluderProxy& Proxy = OcclusionBVH.Proxies.AddDefaulted_GetRef();
+			SetOccluderProxy(*Occluder, Proxy);
+
+			if (!OldProxies.IsValidIndex(OldProxyIndex))
+			{
+				NotifyOccluderChanged(Proxy.Bounds);
+				continue;
+			}
+
+			KeptOldProxies[OldProxyIndex] = true;
+			if (!(OldProxies[OldProxyIndex].Bounds == Proxy.Bounds))
+				NotifyOccluderChanged(OldProxies[OldProxyIndex].Bounds + Proxy.Bounds);
+		}
+		OcclusionBVH.Build();
+
+		for (int32 i = 0; i < OldProxies.Num(); ++i)
+		{
+			if (!KeptOldProxies[i])
+				NotifyOccluderChanged(OldProxies[i].Bounds);
+		}
+
+		bOccludersChanged = false;
+		MovedOccluders.Reset();
+		return;
+	}
+
+	for (const TWeakObjectPtr<ULXROccluderComponent>& Occluder : MovedOccluders)
+	{
+		if (!Occluder.IsValid() || !OcclusionBVH.Proxies.IsValidIndex(Occluder->OccluderProxyIndex))
+			continue;
+
+		FLXROccluderProxy& Proxy = OcclusionBVH.Proxies[Occluder->OccluderProxyIndex];
+		const FBox OldBounds = Proxy.Bounds;
+		SetOccluderProxy(*Occluder, Proxy);
+		NotifyOccluderChanged(OldBounds + Proxy.Bounds);
+	}
+	OcclusionBVH.Refit();
+	MovedOccluders.Reset();
+}
+
+void ULXRSubsystem::RequestDetectorUpdate(ULXRDetectionComponent* DetectionComponent)
+{
+	if (DetectionComponent->bPendingBudgetUpdate)
+		return;
+
+	DetectionComponent->bPendingBudgetUpdate = true;
+	PendingDetectors.Add(DetectionComponent);
+}
+
+bool ULXRSubsystem::IsTraceBudgetEnabled() const
+{
+	return GetDefault<ULXRSettings>()->bEnableTraceBudget;
+}
+
+bool ULXRSubsystem::HasTraceBudget() const
+{
+	const ULXRSettings* Settings = GetDefault<ULXRSettings>();
+	if (!Settings->bEnableTraceBudget)
+		return true;
+
+	const int32 TraceCount = FrameTraceCountFrame == GFrameCounter ? FrameTraceCount : 0;
+	if (Settings->MaxTracesPerFrame > 0 && TraceCount >= Settings->MaxTracesPerFrame)
+		return false;
+
+	if (bServingDetectors && Settings->MaxTraceTimePerFrameMs > 0 && (FPlatformTime::Seconds() - FrameBudgetStartTime) * 1000.0 >= Settings->MaxTraceTimePerFrameMs)
+		return false;
+
+	return true;
+}
+
+void ULXRSubsystem::ConsumeTraceBudget(int32 TraceCount)
+{
+	if (FrameTraceCountFrame != GFrameCounter)
+	{
+		FrameTraceCountFrame = GFrameCounter;
+		FrameTraceCount = 0;
+	}
+	FrameTraceCount += TraceCount;
+}
+
+float ULXRSubsystem::AssignDetectorPhase()
+{
+	if (!GetDefault<ULXRSettings>()->bStaggerDetectorUpdates)
+		return 0;
+
+	//Golden ratio sequence, every new phase lands in the largest gap left by the previous ones.
+	constexpr double GoldenRatioConjugate = 0.6180339887498949;
+	const double Phase = FMath::Frac(NextDetectorPhaseIndex * GoldenRatioConjugate);
+	NextDetectorPhaseIndex++;
+	return static_cast<float>(Phase);
+}
+
+void ULXRSubsystem::ServeDetectorsByPriority()
+{
+	//Traces of on demand evaluations and earlier ticks this frame already count against the budget.
+	ConsumeTraceBudget(0);
+	FrameBudgetStartTime = FPlatformTime::Seconds();
+
+	PendingDetectors.RemoveAllSwap([](const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent)
+	{
+		return !DetectionComponent.IsValid();
+	}, false);
+
+	if (PendingDetectors.Num() == 0)
+	{
+		SET_DWORD_STAT(STAT_BUDGETTRACES, FrameTraceCount);
+		SET_DWORD_STAT(STAT_BUDGETDEFERRED, 0);
+		return;
+	}
+
+	FVector ViewLocation;
+	const bool bHasViewLocation = GetViewLocation(ViewLocation);
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	for (const TWeakObjectPtr<ULXRDetectionComponent>& DetectionComponent : PendingDetectors)
+	{
+		DetectionComponent->BudgetPriority = GetDetectorPriority(*DetectionComponent, ViewLocation, bHasViewLocation, Now);
+	}
+
+	PendingDetectors.Sort([](const TWeakObjectPtr<ULXRDetectionComponent>& A, const TWeakObjectPtr<ULXRDetectionComponent>& B)
+	{
+		return A->BudgetPriority > B->BudgetPriority;
+	});
+
+	bServingDetectors = true;
+	int32 Served = 0;
+	for (; Served < PendingDetectors.Num(); ++Served)
+	{
+		if (!HasTraceBudget())
+			break;
+
+		ULXRDetectionComponent* DetectionComponent = PendingDetectors[Served].Get();
+		if (!IsValid(DetectionComponent))
+			continue;
+
+		DetectionComponent->bPendingBudgetUpdate = false;
+		DetectionComponent->LastBudgetServedTime = Now;
+		DetectionComponent->CheckRelevantLights();
+	}
+	bServingDetectors = false;
+
+	//Whatever did not fit in the budget stays queued and gains staleness priority for the next frame.
+	PendingDetectors.RemoveAt(0, Served, false);
+
+	SET_DWORD_STAT(STAT_BUDGETTRACES, FrameTraceCount);
+	SET_DWORD_STAT(STAT_BUDGETDEFERRED, PendingDetectors.Num());
+}
+
+float ULXRSubsystem::GetDetectorPriority(const ULXRDetectionComponent& DetectionComponent, const FVector& ViewLocation, bool bHasViewLocation, double Now) const
+{
+	const ULXRSettings* Settings = GetDefault<ULXRSettings>();
+
+	float Proximity = 0;
+	if (bHasViewLocation)
+	{
+		const float Distance = FVector::Dist(ViewLocation, DetectionComponent.GetOwner()->GetActorLocation());
+		Proximity = 1.f - FMath::Clamp(Distance / Settings->ProximityPriorityDistance, 0.f, 1.f);
+	}
+
+	const float Staleness = static_cast<float>(Now - DetectionComponent.LastBudgetServedTime);
+
+	return Proximity * Settings->ProximityPriorityWeight
+		+ DetectionComponent.DetectionImportance * Settings->ImportancePriorityWeight
+		+ Staleness * Settings->StalenessPriorityWeight;
+}
+
+bool ULXRSubsystem::GetViewLocation(FVector& OutViewLocation) const
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (!IsValid(PlayerController))
+		return false;
+
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(OutViewLocation, ViewRotation);
+	return true;
+}
@@ -0,0 +1,89 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRSunHeightField.h"
+#include "Engine/World.h"
+#include "CollisionQueryParams.h"
+
+void FLXRSunHeightField::Reset(const FVector& InSunDirection, const FBox& Bounds, float InCellSize, int32 MaxResolution)
+{
+	SunDirection = InSunDirection.GetSafeNormal();
+	SunDirection.FindBestAxisVectors(AxisU, AxisV);
+
+	FVector Corners[8];
+	Bounds.GetVertices(Corners);
+	FBox2D PlaneBounds(ForceInit);
+	MinHeight = MAX_flt;
+	MaxHeight = -MAX_flt;
+	for (const FVector& Corner : Corners)
+	{
+		PlaneBounds += FVector2D(Corner | AxisU, Corner | AxisV);
+		const float Height = Corner | SunDirection;
+		MinHeight = FMath::Min(MinHeight, Height);
+		MaxHeight = FMath::Max(MaxHeight, Height);
+	}
+
+	const FVector2D PlaneSize = PlaneBounds.GetSize();
+	const int32 Resolution = FMath::Max(MaxResolution, 1);
+	CellSize = FMath::Max3(InCellSize, PlaneSize.X / Resolution, PlaneSize.Y / Resolution);
+	CellSize = FMath::Max(CellSize, 1.f);
+	Origin = PlaneBounds.Min;
+	SizeU = FMath::Max(FMath::CeilToInt(PlaneSize.X / CellSize), 1);
+	SizeV = FMath::Max(FMath::CeilToInt(PlaneSize.Y / CellSize), 1);
+
+	Heights.Reset();
+	Heights.SetNumUninitialized(SizeU * SizeV);
+	for (float& Height : Heights)
+		Height = -MAX_flt;
+}
+
+void FLXRSunHeightField::BuildRow(const UWorld& World, int32 Row, const FCollisionQueryParams& QueryParams)
+{
+	const FCollisionObjectQueryParams ObjectQueryParams(ECC_WorldStatic);
+	const float V = Origin.Y + (Row + 0.5f) * CellSize;
+	for (int32 Column = 0; Column < SizeU; ++Column)
+	{
+		const float U = Origin.X + (Column + 0.5f) * CellSize;
+		const FVector PlanePoint = AxisU * U + AxisV * V;
+
+		FHitResult Hit;
+		if (World.LineTraceSingleByObjectType(Hit, PlanePoint + SunDirection * MaxHeight, PlanePoint + SunDirection * MinHeight, ObjectQueryParams, QueryParams))
+			Heights[Column + Row * SizeU] = Hit.Location | SunDirection;
+	}
+}
+
+bool FLXRSunHeightField::Sample(const FVector& Point, float Bias, bool& OutVisible) const
+{
+	if (IsEmpty())
+		return false;
+
+	const int32 Column = FMath::FloorToInt(((Point | AxisU) - Origin.X) / CellSize);
+	const int32 Row = FMath::FloorToInt(((Point | AxisV) - Origin.Y) / CellSize);
+	if (Column < 0 || Column >= SizeU || Row < 0 || Row >= SizeV)
+		return false;
+
+	OutVisible = (Point | SunDirection) + Bias >= Heights[Column + Row * SizeU];
+	return true;
+}
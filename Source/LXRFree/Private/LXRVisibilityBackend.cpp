@@ -0,0 +1,64 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "LXRVisibilityBackend.h"
+#include "LXROcclusionBVH.h"
+#include "LXROcclusionGrid.h"
+#include "LXRSubsystem.h"
+#include "Engine/World.h"
+
+void ILXRVisibilityBackend::GetBlockedSegments(const UWorld& World, TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, const FLXRVisibilityQuery& Query, FLXRBlockedBitArray& OutBlocked) const
+{
+	check(Starts.Num() == Ends.Num());
+	OutBlocked.Init(false, Starts.Num());
+	for (int32 i = 0; i < Starts.Num(); ++i)
+	{
+		if (IsBlocked(World, Starts[i], Ends[i], Query))
+			OutBlocked[i] = true;
+	}
+}
+
+bool FLXRPhysicsVisibilityBackend::IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const
+{
+	return World.LineTraceTestByChannel(Start, End, Query.TraceChannel, Query.QueryParams ? *Query.QueryParams : FCollisionQueryParams::DefaultQueryParam);
+}
+
+bool FLXROccluderBVHVisibilityBackend::IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const
+{
+	INC_DWORD_STAT(STAT_OCCLUDERBVHRAYS);
+	return BVH.IsBlocked(Start, End, Query.IgnoredOwners);
+}
+
+void FLXROccluderBVHVisibilityBackend::GetBlockedSegments(const UWorld& World, TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, const FLXRVisibilityQuery& Query, FLXRBlockedBitArray& OutBlocked) const
+{
+	INC_DWORD_STAT_BY(STAT_OCCLUDERBVHRAYS, Starts.Num());
+	BVH.GetBlockedSegments(Starts, Ends, OutBlocked, Query.IgnoredOwners);
+}
+
+bool FLXROcclusionGridVisibilityBackend::IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const
+{
+	INC_DWORD_STAT(STAT_OCCLUSIONGRIDRAYS);
+	return Grid.IsBlocked(Start, End);
+}
@@ -0,0 +1,247 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Misc/AutomationTest.h"
+#include "HAL/MemoryBase.h"
+#include "CollisionQueryParams.h"
+#include "Engine/Engine.h"
+#include "Engine/PointLight.h"
+#include "Engine/World.h"
+#include "LXRDetectionComponent.h"
+#include "LXRFrameSnapshot.h"
+#include "LXROcclusionBVH.h"
+#include "LXRSourceComponent.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace LXRAllocationTest
+{
+	//Forwards to the allocator it was created over and counts allocations of the thread that created it.
+	//Lives as long as the module, other threads can still be inside it after GMalloc is restored.
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInnerMalloc)
+			: InnerMalloc(InInnerMalloc)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			//Realloc to zero is a free.
+			if (Count > 0)
+				CountAllocation();
+			return InnerMalloc->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+				CountAllocation();
+			return InnerMalloc->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override { InnerMalloc->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return InnerMalloc->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return InnerMalloc->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { InnerMalloc->Trim(bTrimThreadCaches); }
+		virtual bool IsInternallyThreadSafe() const override { return InnerMalloc->IsInternallyThreadSafe(); }
+		virtual const TCHAR* GetDescriptiveName() override { return TEXT("LXRCountingMalloc"); }
+
+		void Begin()
+		{
+			CountingThreadId = FPlatformTLS::GetCurrentThreadId();
+			AllocationCount = 0;
+			GMalloc = this;
+		}
+
+		int32 End()
+		{
+			GMalloc = InnerMalloc;
+			CountingThreadId = 0;
+			return AllocationCount;
+		}
+
+	private:
+		void CountAllocation()
+		{
+			if (FPlatformTLS::GetCurrentThreadId() == CountingThreadId)
+				AllocationCount++;
+		}
+
+		FMalloc* InnerMalloc;
+		uint32 CountingThreadId = 0;
+		int32 AllocationCount = 0;
+	};
+
+	FCountingMalloc& GetCountingMalloc()
+	{
+		static FCountingMalloc CountingMalloc(GMalloc);
+		return CountingMalloc;
+	}
+
+	void AddOccluder(FLXROcclusionBVH& BVH, const FVector& Location, const FVector& Extent)
+	{
+		FLXROccluderProxy& Proxy = BVH.Proxies.AddDefaulted_GetRef();
+		Proxy.Transform = FTransform(Location);
+		Proxy.Extent = Extent;
+		Proxy.UpdateBounds();
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLXRVisibilityHotPathAllocationTest, "LXR.Allocations.VisibilityHotPath", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLXRVisibilityHotPathAllocationTest::RunTest(const FString& Parameters)
+{
+	using namespace LXRAllocationTest;
+
+	//Everything that is allowed to allocate once is set up and warmed up before counting.
+	FLXROcclusionBVH BVH;
+	for (int32 i = 0; i < 32; ++i)
+	{
+		AddOccluder(BVH, FVector(i * 200.0, 0, 0), FVector(50));
+	}
+	BVH.Build();
+
+	ULXRSourceComponent* LightSourceComponent = NewObject<ULXRSourceComponent>();
+	LightSourceComponent->IgnoreVisibilityActors.Add(NULL);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LXRAllocationTest));
+	for (AActor* IgnoredActor : LightSourceComponent->GetVisibilityIgnoredActors())
+		QueryParams.AddIgnoredActor(IgnoredActor);
+
+	const TObjectKey<AActor> IgnoredOwners[] = {TObjectKey<AActor>(), TObjectKey<AActor>()};
+	FCountingMalloc& CountingMalloc = GetCountingMalloc();
+
+	CountingMalloc.Begin();
+	int32 BlockedCount = 0;
+	for (int32 Check = 0; Check < 16; ++Check)
+	{
+		//Same scratch types and sizes CheckVisibility uses for one light.
+		FLXRTraceTargetArray TraceStarts;
+		FLXRTraceTargetArray TraceEnds;
+		FLXRIndexArray TracedTargets;
+		FLXRBlockedBitArray Blocked;
+		for (int32 i = 0; i < 16; ++i)
+		{
+			TraceStarts.Add(FVector(i * 400.0, -500, 0));
+			TraceEnds.Add(FVector(i * 400.0, 500, 0));
+			TracedTargets.Add(i);
+		}
+
+		BVH.GetBlockedSegments(TraceStarts, TraceEnds, Blocked, IgnoredOwners);
+		BlockedCount += Blocked.CountSetBits();
+
+		if (BVH.IsBlocked(TraceStarts[0], TraceEnds[0], IgnoredOwners))
+			BlockedCount++;
+
+		QueryParams.ClearIgnoredActors();
+		for (AActor* IgnoredActor : LightSourceComponent->GetVisibilityIgnoredActors())
+			QueryParams.AddIgnoredActor(IgnoredActor);
+	}
+	const int32 AllocationCount = CountingMalloc.End();
+
+	TestTrue(TEXT("Segments crossing occluders are blocked"), BlockedCount > 0);
+	TestEqual(TEXT("Allocations on visibility hot path"), AllocationCount, 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLXRDetectionHotPathAllocationTest, "LXR.Allocations.DetectionHotPath", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLXRDetectionHotPathAllocationTest::RunTest(const FString& Parameters)
+{
+	using namespace LXRAllocationTest;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	//Components registered after their owner began play begin play right away.
+	AActor* LightActor = World->SpawnActor<APointLight>(FVector(200, 0, 0), FRotator::ZeroRotator);
+	ULXRSourceComponent* LightSourceComponent = NewObject<ULXRSourceComponent>(LightActor);
+	LightSourceComponent->RegisterComponent();
+
+	AActor* DetectorActor = World->SpawnActor<AActor>();
+	USceneComponent* DetectorRoot = NewObject<USceneComponent>(DetectorActor);
+	DetectorActor->SetRootComponent(DetectorRoot);
+	DetectorRoot->RegisterComponent();
+	ULXRDetectionComponent* DetectionComponent = NewObject<ULXRDetectionComponent>(DetectorActor);
+	//Nothing blocks light, visibility is resolved without touching the physics scene.
+	DetectionComponent->VisibilityBackend = ELXRVisibilityBackend::AlwaysVisible;
+	DetectionComponent->RegisterComponent();
+
+	//Pair is added directly, late begin play and relevancy timers never run in this world.
+	const int32 PairSlot = DetectionComponent->AddLightPair(LightActor);
+	FLXRRelevantCheckResult Result;
+
+	//First checks grow pair records, passed lights and scratch arrays to their steady state.
+	for (int32 Check = 0; Check < 4; ++Check)
+	{
+		DetectionComponent->DoRelevantCheckOnLightPair(PairSlot, Result, false);
+		DetectionComponent->ApplyRelevantCheckResult(Result);
+		DetectionComponent->GetLXR();
+	}
+
+	FCountingMalloc& CountingMalloc = GetCountingMalloc();
+	CountingMalloc.Begin();
+	int32 PassedCount = 0;
+	for (int32 Check = 0; Check < 16; ++Check)
+	{
+		FLXRTraceTargetArray TraceTargets;
+		DetectionComponent->GetTraceTargets(true, TraceTargets);
+		DetectionComponent->DoRelevantCheckOnLightPair(PairSlot, Result, false);
+		DetectionComponent->ApplyRelevantCheckResult(Result);
+		DetectionComponent->GetLXR();
+		if (Result.bPassed)
+			PassedCount++;
+	}
+	const int32 AllocationCount = CountingMalloc.End();
+
+	TestEqual(TEXT("Light in range passes relevant check"), PassedCount, 16);
+	TestTrue(TEXT("Passed light contributes to LXR"), DetectionComponent->CombinedLXRIntensity > 0);
+	TestEqual(TEXT("Allocations on detection hot path"), AllocationCount, 0);
+
+	DetectorActor->Destroy();
+	LightActor->Destroy();
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/BulkData.h"
+
+//Baked LXR data kept out of the owning level export data.
+//Payload is saved as non inline bulk data, so cooked payloads of a streaming level or World Partition cell stay on disk
+//until owner begins play and loads them, and are freed again when owner ends play.
+struct LXRFREE_API FLXRBulkPayload
+{
+	FLXRBulkPayload();
+	~FLXRBulkPayload();
+
+	//Replaces payload, used by editor bakes.
+	void Store(const TArray<uint8>& Bytes);
+
+	bool IsEmpty() const { return BulkData.GetBulkDataSize() == 0; }
+
+	//Call from owner Serialize. Archives older than FLXRCustomVersion::AddedBulkPayload are left empty.
+	void Serialize(FArchive& Ar, UObject* Owner);
+
+	//Reads payload without blocking, OnLoaded runs on game thread. Payload already in memory completes immediately.
+	//Previous load is cancelled.
+	void LoadAsync(TFunction<void(TArray<uint8>&&)>&& OnLoaded);
+
+	//OnLoaded of a pending load is not called.
+	void Cancel();
+
+private:
+	struct FLoadState
+	{
+		TAtomic<bool> bCancelled{false};
+		TFunction<void(TArray<uint8>&&)> OnLoaded;
+	};
+
+	FByteBulkData BulkData;
+	IBulkDataIORequest* Request = NULL;
+	TSharedPtr<FLoadState, ESPMode::ThreadSafe> LoadState;
+};
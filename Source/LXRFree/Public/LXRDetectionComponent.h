@@ -27,10 +27,15 @@ SOFTWARE.
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "CollisionQueryParams.h"
+#include "WorldCollision.h"
+#include "Tasks/Task.h"
+#include "LXRFrameSnapshot.h"
+#include "LXRVisibilityBackend.h"
 #include "LXRDetectionComponent.generated.h"
 
 class ULXRSubsystem;
 class ULXRSourceComponent;
+struct FLXRLightOcclusionMap;
 
 // DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnLightCheckChanged, int, PassedCount, ULXRSourceComponent*, LightSourceComponent);
 
@@ -73,11 +78,163 @@ enum class ERelevancyCheckType
 	Smart UMETA(DisplayName = "Smart"),
 };
 
+UENUM(BlueprintType)
+enum class EDetectionEvaluationMode : uint8
+{
+	// Calculate LXR continuously.
+	Continuous UMETA(DisplayName = "Continuous"),
+	// Calculate nothing until LXR is requested with RequestLXR or something has registered interest with AddLXRInterest.
+	OnDemand UMETA(DisplayName = "On Demand"),
+};
+
 UENUM(BlueprintType)
 enum class ERelevantTraceType : uint8
 {
 	// Use Synchronous LineTrace for relevant light visibility checks
 	Sync UMETA(DisplayName = "Synchronous LineTrace"),
+	// Relevancy culling runs as a task on the frame snapshot and visibility uses async line traces that complete with the engine frame.
+	// Results lag one to two frames behind.
+	Pipelined UMETA(DisplayName = "Pipelined"),
+	// Visibility rays of all detection components are traced together by LXR subsystem in one ParallelFor at end of frame.
+	ParallelFor UMETA(DisplayName = "ParallelFor"),
+};
+
+//Stage of the pipelined relevant check, one stage is advanced per relevant check tick.
+enum class ELXRPipelineStage : uint8
+{
+	//Nothing in flight, next batch starts with relevancy culling.
+	Idle,
+	//Culling task reads the frame snapshot.
+	Culling,
+	//Async visibility traces are in flight.
+	Tracing,
+};
+
+//Last visibility trace result between a trace target and a light component.
+struct FLXRVisibilityRecord
+{
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	double Time = -1;
+	bool bVisible = false;
+};
+
+//Record per light component and trace target, light component index major.
+typedef TArray<FLXRVisibilityRecord, TInlineAllocator<8>> FLXRVisibilityRecordArray;
+
+//Visibility record written once the trace of a pipelined or ParallelFor check completes.
+struct FLXRPendingVisibilityRecord
+{
+	int32 RecordIndex = INDEX_NONE;
+	//Index into the trace result array the check is applied with.
+	int32 Trace = INDEX_NONE;
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+};
+
+//Bit per light component index. Inline storage covers 32 light components, more spill to heap.
+typedef TBitArray<TInlineAllocator<1>> FLXRComponentBitArray;
+
+//Detection state of one relevant light for a detection component.
+//Lives in a slot of ULXRDetectionComponent::LightPairs for as long as the light stays relevant.
+struct FLXRLightPair
+{
+	TWeakObjectPtr<AActor> LightSourceOwner;
+	//Key of the slot in LightPairSlotsByOwner, stays valid after owner is destroyed.
+	TObjectKey<AActor> LightSourceOwnerKey;
+	TWeakObjectPtr<ULXRSourceComponent> LightSourceComponent;
+
+	//Set bit per light component index that passed the last relevant check.
+	FLXRComponentBitArray PassedComponents;
+	//Result bit per relevant check, newest in lowest bit. Set bit is a failed check.
+	uint32 FailHistory = 0;
+	int32 ConsecutiveFails = 0;
+
+	//Position of this slot in RelevantLightSlots and PassedLightSlots.
+	int32 RelevantIndex = INDEX_NONE;
+	int32 PassedIndex = INDEX_NONE;
+
+	double LastCheckTime = -1;
+	float LastContribution = 0;
+
+	//Visibility results indexed by ComponentIndex * TraceTargets + TargetIndex.
+	FLXRVisibilityRecordArray VisibilityRecords;
+};
+
+//Outcome of one relevant check. A check writes only its own result slot and game thread applies all results of a batch in one pass.
+//Pipelined culling task fills slots of FLXRPipelinedCheck off game thread, it reads only the frame snapshot.
+//Sync checks fill slots on game thread, see DoRelevantCheckOnLightPair.
+struct FLXRRelevantCheckResult
+{
+	int32 PairSlot = INDEX_NONE;
+	FLXRIndexArray PassedComponents;
+	//False if light was skipped, result is not applied then.
+	bool bChecked = false;
+	bool bPassed = false;
+	bool bAlwaysRelevant = false;
+	//Relevancy is re-evaluated only when this fail exceeds MaxConsecutiveFails.
+	bool bStillRelevant = true;
+};
+
+//One relevant check whose visibility traces complete later. Used by Pipelined and ParallelFor trace types.
+struct FLXRPipelinedCheck
+{
+	//Pair slot can be reused while the check is in flight, result is applied only if the slot still holds this light.
+	TObjectKey<AActor> LightSourceOwner;
+	FLXRRelevantCheckResult Result;
+	bool bRelevant = false;
+	float RequiredChecksToPass = 0;
+	//Traces of this check are [FirstTrace, FirstTrace + NumTraces) of the trace result array.
+	int32 FirstTrace = 0;
+	int32 NumTraces = 0;
+	//Segments answered without a trace when the check was submitted, like sun height field samples.
+	int32 NumResolved = 0;
+	int32 ResolvedPassedChecks = 0;
+	//Records of traced segments, only filled with bUseVisibilityCache.
+	TArray<FLXRPendingVisibilityRecord, TInlineAllocator<4>> PendingRecords;
+	double TraceTime = 0;
+};
+
+//Iterates light components that passed the last relevant check of one light, straight from the passed component bits.
+class LXRFREE_API FLXRPassedComponentIterator
+{
+public:
+	FLXRPassedComponentIterator(TConstArrayView<ULightComponent*> InLightComponents, const FLXRComponentBitArray& InPassedComponents);
+
+	explicit operator bool() const { return (bool)PassedComponentIt; }
+	FLXRPassedComponentIterator& operator++();
+	ULightComponent* operator*() const { return LightComponents[GetComponentIndex()]; }
+	int32 GetComponentIndex() const { return PassedComponentIt.GetIndex(); }
+
+private:
+	void SkipInvalidComponents();
+
+	TConstArrayView<ULightComponent*> LightComponents;
+	TConstSetBitIterator<TInlineAllocator<1>> PassedComponentIt;
+};
+
+//Iterates passed lights of a detection component without copying them.
+//Do not hold on to it over frames, relevant checks reorder passed lights.
+class LXRFREE_API FLXRPassedLightIterator
+{
+public:
+	FLXRPassedLightIterator(const TSparseArray<FLXRLightPair>& InLightPairs, TConstArrayView<int32> InPassedLightSlots);
+
+	explicit operator bool() const { return PassedLightSlots.IsValidIndex(Index); }
+	FLXRPassedLightIterator& operator++() { ++Index; return *this; }
+
+	AActor* GetLightSourceOwner() const;
+	ULXRSourceComponent* GetLightSourceComponent() const;
+	FLXRPassedComponentIterator CreatePassedComponentIterator() const;
+	//LXR intensity this light added on last LXR calculation.
+	float GetLastContribution() const { return GetLightPair().LastContribution; }
+
+private:
+	const FLXRLightPair& GetLightPair() const { return LightPairs[PassedLightSlots[Index]]; }
+
+	const TSparseArray<FLXRLightPair>& LightPairs;
+	TConstArrayView<int32> PassedLightSlots;
+	int32 Index = 0;
 };
 
 /*Component for detecting light emitted by actors with LXRLightSource component. */
@@ -182,10 +339,18 @@ public:
 	ETraceTarget RelevantTargetType = ETraceTarget::ActorBounds;
 
 	//Rate for checking if relevant light illuminates Actor.
-	// Used for Sync, ParallelFor, Multithread RelevantTraceTypes
+	// Used for Sync, Pipelined, ParallelFor RelevantTraceTypes
 	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant")
 	float RelevantLightCheckRate = 0.01;
 
+	//How relevant light visibility checks are run.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant")
+	ERelevantTraceType RelevantTraceType = ERelevantTraceType::Sync;
+
+	//What answers relevant light visibility checks.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant")
+	ELXRVisibilityBackend VisibilityBackend = ELXRVisibilityBackend::ProjectDefault;
+
 	//How many relevant lights we process per check.
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Relevant")
 	int RelevantLightBatchCount = 50;
@@ -198,10 +363,65 @@ public:
 	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant", meta=(DisplayName="Passed Targets Required", ClampMin = "0.1", ClampMax = "1", UIMin = "0.1", UIMax = "1", HideEditConditionToggle, EditCondition = "RelevantTargetType != ETraceTarget::ActorLocation"))
 	float TracesRequired = 0.5f;
 
+	//Reuse last visibility result of a trace target and light while both have moved less than VisibilityCacheMovementThreshold.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant")
+	bool bUseVisibilityCache = false;
+
+	//Max movement of trace target or light before visibility is traced again.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant", meta=(HideEditConditionToggle, EditCondition = "bUseVisibilityCache", ClampMin = "0"))
+	float VisibilityCacheMovementThreshold = 5.f;
+
+	//Max age in seconds of a reused visibility result.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant", meta=(HideEditConditionToggle, EditCondition = "bUseVisibilityCache", ClampMin = "0"))
+	float VisibilityCacheMaxAge = 0.5f;
+
+	//Chance to trace again even if visibility result could be reused. Catches dynamic occluders.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant", meta=(HideEditConditionToggle, EditCondition = "bUseVisibilityCache", ClampMin = "0", ClampMax = "1", UIMin = "0", UIMax = "1"))
+	float VisibilityCacheRevalidationChance = 0.05f;
+
 	//How many  times in row relevant check must fail to remove light from relevant list. 
 	UPROPERTY(EditAnywhere, Category="LXR|Detection|Relevant")
 	float MaxConsecutiveFails = 5;
 
+	//When to calculate LXR.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Evaluation")
+	EDetectionEvaluationMode EvaluationMode = EDetectionEvaluationMode::Continuous;
+
+	//How old, in seconds, LXR result can be before RequestLXR calculates it again.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Evaluation", meta=(HideEditConditionToggle, EditCondition = "EvaluationMode == EDetectionEvaluationMode::OnDemand", ClampMin = "0"))
+	float OnDemandStalenessTolerance = 0.2f;
+
+	//RequestLXR scans all lights for relevancy when owner has moved RelevancyLocationThreshold, lights were added or removed,
+	//or last scan is older than this many seconds. Otherwise it only checks lights that are already relevant.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Evaluation", meta=(HideEditConditionToggle, EditCondition = "EvaluationMode == EDetectionEvaluationMode::OnDemand", ClampMin = "0"))
+	float OnDemandRelevancyScanInterval = 1.f;
+
+	//Gameplay importance of this detection component.
+	//Used to prioritize detection components when trace budget is enabled in LXR project settings.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Budget", meta=(ClampMin = "0"))
+	float DetectionImportance = 1.f;
+
+	//Put detection component to sleep when its owner, owner pose and all relevant lights have stayed unchanged for DormancyStableTime.
+	//Wakes up when owner moves, a relevant light changes or ULXRSubsystem::NotifyOccluderChanged is called for its area.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="LXR|Detection|Dormancy")
+	bool bAllowDormancy = false;
+
+	//Owner location or trace target change that wakes up dormant detection component.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Dormancy", meta=(HideEditConditionToggle, EditCondition = "bAllowDormancy", ClampMin = "0"))
+	float DormancyLocationThreshold = 5.f;
+
+	//Owner rotation change in degrees that wakes up dormant detection component.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Dormancy", meta=(HideEditConditionToggle, EditCondition = "bAllowDormancy", ClampMin = "0"))
+	float DormancyRotationThreshold = 2.f;
+
+	//How long everything must stay unchanged before going dormant.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Dormancy", meta=(HideEditConditionToggle, EditCondition = "bAllowDormancy", ClampMin = "0"))
+	float DormancyStableTime = 0.5f;
+
+	//Max time to stay dormant before waking up for a full check. 0 stays dormant until something changes.
+	UPROPERTY(EditAnywhere, Category="LXR|Detection|Dormancy", meta=(HideEditConditionToggle, EditCondition = "bAllowDormancy", ClampMin = "0"))
+	float MaxDormantTime = 5.f;
+
 	// UPROPERTY(BlueprintAssignable, Category="LXR|Detection|Relevant")
 	// FOnLightCheckChanged OnLightCheckChanged;
 
@@ -226,56 +446,138 @@ public:
 	UFUNCTION(BlueprintPure, Category="LXR|Detection|PassedLights")
 	TArray<ULightComponent*> GetPassedLightComponents(AActor* LightSourceOwner) ;
 
-	TArray<FVector> GetTraceTargets(const bool& bIsRelevant, const ETraceTarget TargetOverride = ETraceTarget::None) const;
+	//Native, non allocating versions of GetPassedLights and GetPassedLightComponents.
+	int32 GetPassedLightCount() const;
+	FLXRPassedLightIterator CreatePassedLightIterator() const;
+	//Iterator is empty if light did not pass.
+	FLXRPassedComponentIterator CreatePassedLightComponentIterator(const AActor* LightSourceOwner) const;
+
+	void GetTraceTargets(bool bIsRelevant, FLXRTraceTargetArray& OutTraceTargets, const ETraceTarget TargetOverride = ETraceTarget::None) const;
 
 	bool GetIsRelevant(const ULXRSourceComponent& LightSourceComponent) const;
 
+	//Returns LXR, calculating it just in time if last result is older than StalenessTolerance.
+	//Negative StalenessTolerance uses OnDemandStalenessTolerance.
+	//Just in time calculation always uses synchronous traces, RelevantTraceType applies to continuous evaluation only.
+	UFUNCTION(BlueprintCallable, Category="LXR|Detection|Evaluation")
+	void RequestLXR(FLinearColor& OutColor, float& OutIntensity, float StalenessTolerance = -1.f);
+
+	//Keeps On Demand detection component calculating LXR continuously while Interested is valid and registered.
+	//For example register while owner is being perceived.
+	UFUNCTION(BlueprintCallable, Category="LXR|Detection|Evaluation")
+	void AddLXRInterest(UObject* Interested);
+
+	UFUNCTION(BlueprintCallable, Category="LXR|Detection|Evaluation")
+	void RemoveLXRInterest(UObject* Interested);
+
+	UFUNCTION(BlueprintPure, Category="LXR|Detection|Dormancy")
+	bool IsDormant() const;
+
+	//Wakes up dormant detection component.
+	UFUNCTION(BlueprintCallable, Category="LXR|Detection|Dormancy")
+	void WakeUp();
+
 private:
 	friend class ULXRAISightDetectionComponent;
+	friend class ULXRSubsystem;
+	friend class FLXRDetectionHotPathAllocationTest;
 	virtual void BeginPlay() override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
-	void GetLightSystemLights();
-
 	void AddLight(AActor* LightSource);
 	void RemoveLight(AActor* LightSource);
+	void AddLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSources);
+	void RemoveLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSources);
 	void CheckAllLightForRelevancy();
 	void CheckRelevantLights();
-	void IncreaseFailCount(const TWeakObjectPtr<AActor>& LightSourceOwner);
-	void IncreaseFailCountIfNotAlwaysRelevantLightFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner);
-	void CheckAndRemoveIfLightNotRelevant(const TWeakObjectPtr<AActor>& LightSourceOwner, bool IsFromThread = false);
-	void CheckAndRemoveIfLightNotRelevantFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner);
+	void IncreaseFailCount(int32 PairSlot);
+	void RemoveNotRelevantLight(int32 PairSlot);
+
+	int32 AddLightPair(const TWeakObjectPtr<AActor>& LightSourceOwner);
+	void RemoveLightPair(int32 PairSlot);
+	int32 FindLightPairSlot(const AActor* LightSourceOwner) const;
 
 	void AddNewLights();
 	void RemoveNonRelevantLights();
 	void AddLightToNewRelevantList(const TWeakObjectPtr<AActor>& LightSourceOwner);
+	//Lights baked into a light grid are not scanned, lights of the cell detection component is in are relevant instead.
+	void AddLightGridRelevantLights();
 	void AddNewRelevantLights();
 	void RemoveRedundantLights();
 	void RemoveAllStaleLights();
 	void RemoveStaleLightsByLightArrayType(ELightArrayType LightArrayType);
-	void LightPassed(const TWeakObjectPtr<AActor>& LightSourceOwner, const TArray<int>& PassedComponents);
-	void LightPassedFromThread(const TWeakObjectPtr<AActor>& LightSourceOwner, const TArray<int>& PassedComponents);
-	void RemovePassedLight(const TWeakObjectPtr<AActor>& LightSourceOwner);
+	void LightPassed(int32 PairSlot, const FLXRIndexArray& PassedComponents);
+	void RemovePassedLight(int32 PairSlot);
 	void ChangeSmartLightArray(const ELightArrayType& From, const ELightArrayType& To, const TWeakObjectPtr<AActor>& LightSourceOwner);
 	void GetLXR();
 
+	bool ShouldEvaluateContinuously();
+	void EvaluateLXRNow();
+	//Relevancy pass over every light for EvaluateLXRNow, new relevant lights are added before returning.
+	void ScanAllLightsForRelevancy();
+	//Checks relevant lights deferred by trace budget and updates LXR, used when component does not evaluate continuously.
+	void FinishDeferredRelevantChecks();
+	void ApplySmartLightArrayChanges();
+
+	bool UpdateDormancy(float DeltaTime);
+	bool IsDetectionStateStable();
+	uint32 GetRelevantLightsChangeHash() const;
+	void LeaveDormancy();
+	//Registered or unregistered lights wake dormant component only if they can change its LXR.
+	bool DoLightsAffectDormancy(TConstArrayView<TWeakObjectPtr<AActor>> LightSources, bool bAdded) const;
+
 	bool CheckDirectionalLight(const ULightComponent& LightSourceComponent, const FVector& Start) const;
 	bool CheckDistance(const ULXRSourceComponent& LightSourceComponent, const ULightComponent& LightComponent, const FVector& Start, const FVector& End) const;
 	bool CheckDistance(const ULXRSourceComponent& LightSourceComponent) const;
 	bool CheckAttenuation(const ULightComponent& LightComponent, const FVector& Start, const FVector& End, bool IsRect) const;
 	bool CheckDirection(const ULightComponent& LightComponent, const FVector& Start, const FVector& End) const;
-	bool CheckVisibility(const TArray<ULightComponent*>& LightComponents, const TArray<int>& PassedComponents, TArray<int>& PassedTargets, bool IsLightSenseCheck = false);
+	bool CheckVisibility(const TArray<ULightComponent*>& LightComponents, const FLXRIndexArray& PassedComponents, FLXRIndexArray& PassedTargets, FLXRLightPair* LightPair = NULL, bool IsLightSenseCheck = false);
+	bool CanReuseVisibilityRecord(const FLXRVisibilityRecord& Record, const FVector& Start, const FVector& End, double Now) const;
+	//Visibility records of pair sized for its light components and trace targets, NULL when visibility cache is off.
+	FLXRVisibilityRecordArray* GetVisibilityRecords(FLXRLightPair* LightPair, int32 NumLightComponents, int32 NumTraceTargets) const;
+	//Answers visibility of one segment from a reusable visibility record, the sun height field or an occlusion map.
+	//Returns false if segment has to be traced. Used by every relevant trace type before a segment is traced or queued.
+	bool ResolveVisibilityWithoutTrace(const ULightComponent& LightComponent, bool bIsDirectionalLight, const ULXRSourceComponent* LightSourceComponent, const FLXRLightOcclusionMap* OcclusionMap,
+	                                   const FLXRVisibilityRecord* Record, const FVector& Start, const FVector& End, TConstArrayView<TObjectKey<AActor>> IgnoredOwners, double Now, bool& bOutVisible) const;
+	//Writes records of traced segments of a pipelined or ParallelFor check.
+	void ApplyPendingVisibilityRecords(const FLXRPipelinedCheck& Check, TConstArrayView<uint8> TraceVisible);
 	bool CheckIfInsideSpotOrRect(const ULightComponent& LightComponent, const FVector& Start, const FVector& End, bool IsSpot) const;
-	bool CheckIsLightRelevant(const ULXRSourceComponent& LightSourceComponent, TArray<int>& PassedComponents, TArray<int>& PassedTargets, bool IsLightSenseCheck = false, bool IsFromThread = false) const;
+	bool CheckIsLightRelevant(const ULXRSourceComponent& LightSourceComponent, FLXRIndexArray& PassedComponents, FLXRIndexArray& PassedTargets, bool IsLightSenseCheck = false, bool IsFromThread = false) const;
 
 	void GetNextBatchByLightArrayType(TArray<TWeakObjectPtr<AActor>>& OutLightBatch, ELightArrayType LightArrayType);
-	void GetNextRelevantCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& OutLightBatch);
+	//Walks subsystem light list from Cursor, skipping lights tracked in Smart Near and Mid arrays when bSkipTracked is set.
+	void GetNextSharedLightBatch(TArray<TWeakObjectPtr<AActor>>& OutLightBatch, int& Cursor, int BatchCount, bool bSkipTracked) const;
+	bool IsSmartTrackedLight(const TWeakObjectPtr<AActor>& LightSourceOwner) const;
+	void GetNextRelevantCheckLightBatch(TArray<int32>& OutPairSlotBatch);
 
-	void ProcessRelevantCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& LightBatch, bool IsLightSenseCheck = false);
+	void ProcessRelevantCheckLightBatch(TArray<int32>& PairSlotBatch, bool IsLightSenseCheck = false);
 	void ProcessRelevancyCheckLightBatch(TArray<TWeakObjectPtr<AActor>>& LightBatch, ELightArrayType LightArrayType);
 
-	void DoRelevantCheckOnSourceActor(const TWeakObjectPtr<AActor>& LightSourceComponentOwner, bool IsFromThread, bool IsLightSenseCheck = false);
+	//Game thread only. Builds query params in shared scratch, counts trace budget and reads source components.
+	//Writes detection state only through OutResult and the pair visibility records.
+	void DoRelevantCheckOnLightPair(int32 PairSlot, FLXRRelevantCheckResult& OutResult, bool IsFromThread, bool IsLightSenseCheck = false);
+	void ApplyRelevantCheckResult(const FLXRRelevantCheckResult& Result);
+
+	//Advances pipelined relevant checks by one stage: culling, trace submission, trace completion and aggregation.
+	void TickRelevantCheckPipeline();
+	void StartPipelineCulling();
+	void SubmitPipelineTraces();
+	//Aggregates traces of PipelineChecks and applies results. TraceVisible has one entry per trace.
+	void ApplyPipelineResults(TConstArrayView<uint8> TraceVisible);
+
+	//ParallelFor trace type, visibility rays are queued to LXR subsystem and results scattered back with ApplyParallelRelevantChecks.
+	void QueueParallelRelevantChecks();
+	void ApplyParallelRelevantChecks(TConstArrayView<uint8> RayVisible);
+	void CancelRelevantCheckPipeline();
+	//Drops in flight batch but keeps trace delegate bound, pipeline continues from Idle.
+	void ResetRelevantCheckPipeline();
+	bool IsPipelinedCheckCurrent(const FLXRPipelinedCheck& Check) const;
+	void OnPipelineTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum);
+	//Plain data only, runs in the culling task.
+	static void CullPipelinedCheck(const FLXRFrameSnapshot& Snapshot, TConstArrayView<FVector> TraceTargets, float RequiredChecksToPass, FLXRPipelinedCheck& Check);
+	FVector GetVisibilityTraceEnd(const ULightComponent& LightComponent, const FVector& Start) const;
+	const ILXRVisibilityBackend& GetVisibilityBackend() const;
 
 	void AddToSmartArrayBySmartArrayType(ELightArrayType LightArrayType, AActor& LightSourceActor);
 
@@ -287,7 +589,7 @@ private:
 	ELightArrayType GetSmartArrayTypeForLight(const FVector& Start, const FVector& End) const;
 	ELightArrayType GetSmartArrayTypeForLightFromSqrDistance(const float& SqrDist) const;
 
-	FCollisionQueryParams GetCollisionQueryParams(const TArray<AActor*>& ActorsToIgnore) const;
+	const FCollisionQueryParams& GetVisibilityQueryParams(const AActor& LightSourceOwner) const;
 
 	ULXRSourceComponent* GetCurrentLightSourceComponentByType(const ELightArrayType LightArrayType) const;
 	ULightComponent* GetCurrentLightComponentByType(const ELightArrayType LightArrayType) const;
@@ -299,6 +601,9 @@ private:
 	bool bStop = false;
 	bool bUpdateOctreeLights = false;
 	bool LastFrameDrawDebug = false;
+	bool bPendingBudgetUpdate = false;
+	bool bDormant = false;
+	bool bDormancyWakeRequested = false;
 
 	int SmartFarLightIndex = 0;
 	int SmartMidLightIndex = 0;
@@ -314,14 +619,33 @@ private:
 	float StatResetTimer = 0;
 	float LightSenseTimer = 0;
 	float GetCombinedDatasTimer = 0;
+	float BudgetPriority = 0;
+	float SchedulePhase = 0;
+	float DormancyStableTimer = 0;
+	float DormantTimer = 0;
+
+	uint32 DormancyLightsHash = 0;
 
-	mutable FRWLock RelevantDataLockObject;
+	double LastBudgetServedTime = 0;
+	double LastLXRUpdateTime = -1;
+
+	//Reused for every visibility trace, only ignored actors change between light sources.
+	mutable FCollisionQueryParams VisibilityQueryParams;
 
 	FTimerHandle CheckAllLightsTimerHandle;
 	FTimerHandle CheckRelevantLightsTimerHandle;
 	FBoxCenterAndExtent OctreeBoundsTestObject;
 
 	FVector LastRelevancyUpdateLocation;
+	//Last full relevancy scan of EvaluateLXRNow, negative until first scan.
+	double LastOnDemandRelevancyScanTime = -1.0;
+	uint32 OnDemandRelevancyLightsVersion = 0;
+
+	FTransform DormancyTransform;
+	FLXRTraceTargetArray DormancyTraceTargets;
+	FBox DormancyArea = FBox(ForceInit);
+	//Relevant light sources told to tick fast while this component is dormant.
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> DormancyListenedSources;
 
 	TArray<FLinearColor> CombinedLightColors;
 	TMap<int, TArray<FLinearColor>> TargetsCombinedLightColors;
@@ -329,45 +653,58 @@ private:
 	TMap<int, FLinearColor> TargetsCombinedLXRColor;
 	TMap<int, float> TargetsCombinedLXRIntensity;
 
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> RelevantLights;
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> RelevantLightsPassed;
-	UPROPERTY()
+	//Per light state of relevant lights. Slot is freed when light stops being relevant.
+	TSparseArray<FLXRLightPair> LightPairs;
+	//LightPairs slot of each relevant light, light events and relevancy checks look pairs up by actor.
+	TMap<TObjectKey<AActor>, int32> LightPairSlotsByOwner;
+	//Dense lists of LightPairs slots, removal swaps last slot in and patches its stored index.
+	TArray<int32> RelevantLightSlots;
+	TArray<int32> PassedLightSlots;
+
+	//Weak working sets below are not UPROPERTYs, weak pointers do not need GC to walk them.
 	TArray<TWeakObjectPtr<AActor>> NewRelevantLightsToAdd;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> RelevantLightsToRemove;
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> AllLights;
-	UPROPERTY()
+	//All and Smart Far lights are read from subsystem light list, only lights near to this component are tracked here.
 	TArray<TWeakObjectPtr<AActor>> SmartNearLights;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> SmartMidLights;
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> SmartFarLights;
-	UPROPERTY()
+	//Where each light tracked nearer than Smart Far is: SmartNear, SmartMid or Relevant.
+	//Updated when light is queued to move, Far check skips these lights with one lookup.
+	TMap<TWeakObjectPtr<AActor>, ELightArrayType> SmartTrackedLights;
 	TArray<TWeakObjectPtr<AActor>> NewAllLightsToAdd;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> LightsToRemove;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> ErrorAlreadyThrownFromActor;
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> SmartFarLightsToRemove;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> SmartMidLightsToRemove;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> SmartNearLightsToRemove;
-	UPROPERTY()
-	TArray<TWeakObjectPtr<AActor>> SmartFarLightsToAdd;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> SmartMidLightsToAdd;
-	UPROPERTY()
 	TArray<TWeakObjectPtr<AActor>> SmartNearLightsToAdd;
 
-	TMap<TWeakObjectPtr<AActor>, TArray<int>> LightsPassedComponents;
-
-	UPROPERTY()
-	TMap<TWeakObjectPtr<AActor>, int> RelevantLightsFailCounts;
+	TArray<TWeakObjectPtr<UObject>> LXRInterests;
+
+	//LightPairs slots that did not fit in the trace budget, processed before next batch.
+	TArray<int32> DeferredRelevantLightBatch;
+
+	//Batches reused between checks to keep their allocations.
+	TArray<int32> RelevantPairSlotBatch;
+	//Write-once result slot per batch entry.
+	TArray<FLXRRelevantCheckResult> RelevantCheckResults;
+
+	//Pipelined relevant check state, checks are owned by the culling task while it runs.
+	ELXRPipelineStage PipelineStage = ELXRPipelineStage::Idle;
+	UE::Tasks::FTask PipelineCullTask;
+	TArray<FLXRPipelinedCheck> PipelineChecks;
+	TArray<FTraceHandle> PipelineTraces;
+	TArray<uint8> PipelineTraceVisible;
+	//ParallelFor checks are queued and waiting for LXR subsystem to trace them.
+	bool bParallelChecksQueued = false;
+
+	//VisibilityBackend with Project Default resolved at begin play.
+	ELXRVisibilityBackend ResolvedVisibilityBackend = ELXRVisibilityBackend::Physics;
+	int32 PendingPipelineTraces = 0;
+	//Frame pipeline traces were issued in, pipeline is discarded if they are not all answered within a few frames.
+	uint64 PipelineTraceFrame = 0;
+	FTraceDelegate PipelineTraceDelegate;
+	TArray<TWeakObjectPtr<AActor>> RelevancyLightBatch;
+	TArray<AActor*> LightGridCellLights;
 
 	UPROPERTY()
 	USkeletalMeshComponent* SkeletalMeshComponent;
@@ -0,0 +1,140 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class AActor;
+class ULightComponent;
+class ULXRDetectionComponent;
+class ULXRSourceComponent;
+
+//Scratch arrays of the detection hot path. Inline storage covers usual trace target and light component counts without heap allocations.
+typedef TArray<FVector, TInlineAllocator<16>> FLXRTraceTargetArray;
+typedef TArray<int, TInlineAllocator<16>> FLXRIndexArray;
+
+enum class ELXRLightShape : uint8
+{
+	Point,
+	Spot,
+	Rect,
+	Directional,
+};
+
+//Plain copy of the light component state relevancy checks need.
+struct FLXRLightComponentRecord
+{
+	FTransform Transform;
+	FLinearColor Color = FLinearColor::Black;
+	float Intensity = 0;
+	float AttenuationRadius = 0;
+	float OuterConeAngle = 0;
+	float SourceWidth = 0;
+	float SourceHeight = 0;
+	//Already clamped to engine max barn door angle.
+	float BarnDoorAngle = 0;
+	float BarnDoorLength = 0;
+	ELXRLightShape Shape = ELXRLightShape::Point;
+	bool bEnabled = false;
+
+	FVector GetLocation() const { return Transform.GetLocation(); }
+	FVector GetForwardVector() const { return Transform.GetUnitAxis(EAxis::X); }
+};
+
+//Plain copy of one LXR source. Components are LightComponents[FirstComponent, FirstComponent + NumComponents).
+struct FLXRLightRecord
+{
+	//Identity only, never dereferenced off game thread.
+	TObjectKey<AActor> LightSourceOwner;
+	FVector Location = FVector::ZeroVector;
+	float AttenuationMultiplierToBeRelevant = 1;
+	int32 FirstComponent = 0;
+	int32 NumComponents = 0;
+	bool bEnabled = false;
+	bool bAlwaysRelevant = false;
+	bool bSolo = false;
+};
+
+//Plain copy of one detection component. Targets are TraceTargets[First, First + Num).
+struct FLXRDetectorRecord
+{
+	//Identity only, never dereferenced off game thread.
+	TObjectKey<ULXRDetectionComponent> DetectionComponent;
+	FVector Location = FVector::ZeroVector;
+	int32 FirstRelevantTarget = 0;
+	int32 NumRelevantTargets = 0;
+	int32 FirstRelevancyTarget = 0;
+	int32 NumRelevancyTargets = 0;
+};
+
+//Light and detector state of one frame, built by ULXRSubsystem on game thread.
+//Holds no UObject pointers, so any thread can read it while it is the published snapshot.
+//Only Pipelined detection components and lights they have a pair with are included.
+struct LXRFREE_API FLXRFrameSnapshot
+{
+	//Increases with every published snapshot.
+	uint64 Version = 0;
+	double Time = 0;
+	bool bSoloFound = false;
+
+	TArray<FLXRLightRecord> Lights;
+	TArray<FLXRLightComponentRecord> LightComponents;
+	TArray<FLXRDetectorRecord> Detectors;
+	TArray<FVector> TraceTargets;
+
+	TMap<TObjectKey<AActor>, int32> LightIndices;
+	TMap<TObjectKey<ULXRDetectionComponent>, int32> DetectorIndices;
+
+	//Keeps allocations for next build.
+	void Reset();
+
+	//Game thread only.
+	void AddLight(const ULXRSourceComponent& LightSourceComponent);
+	void AddDetector(const ULXRDetectionComponent& DetectionComponent);
+
+	const FLXRLightRecord* FindLight(const AActor* LightSourceOwner) const;
+	const FLXRDetectorRecord* FindDetector(const ULXRDetectionComponent* DetectionComponent) const;
+
+	TConstArrayView<FLXRLightComponentRecord> GetLightComponents(const FLXRLightRecord& Light) const;
+	TConstArrayView<FVector> GetTraceTargets(const FLXRDetectorRecord& Detector, bool bIsRelevant) const;
+};
+
+//Relevancy tests on plain data, safe to call from any thread.
+namespace LXRRelevancy
+{
+	LXRFREE_API bool IsInsideRadius(const FVector& Start, const FVector& End, float Radius);
+	LXRFREE_API bool IsFacing(const FVector& Forward, const FVector& Start, const FVector& End);
+	LXRFREE_API bool IsInsideCone(const FVector& Forward, const FVector& Start, const FVector& End, float ConeAngle);
+	LXRFREE_API bool IsInsideRectLight(const FLXRLightComponentRecord& LightComponent, const FVector& Start);
+
+	//Distance, direction, attenuation and shape tests of one light component against one trace target.
+	//Directional lights always pass, their occlusion is left to visibility traces.
+	LXRFREE_API bool IsLightComponentRelevant(const FLXRLightRecord& Light, const FLXRLightComponentRecord& LightComponent, const FVector& Start);
+
+	//Same rules as ULXRDetectionComponent::CheckIsLightRelevant, RequiredChecksToPass counts passed targets over all light components.
+	LXRFREE_API bool IsLightRelevant(const FLXRFrameSnapshot& Snapshot, const FLXRLightRecord& Light, TConstArrayView<FVector> TraceTargets, float RequiredChecksToPass, FLXRIndexArray& OutPassedComponents);
+}
@@ -0,0 +1,101 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "LXRBulkPayload.h"
+#include "LXRLightGrid.generated.h"
+
+class ULXRSubsystem;
+class ULightComponent;
+
+//Baked clustered light grid of one level. Each cell lists the static LXR lights whose lit volume touches it,
+//spot cones and rect light half spaces are respected. Lights baked into a registered grid are found by cell lookup
+//instead of relevancy scanning every light.
+//Place one per level or World Partition cell and bake it in editor. Cell lists are bulk data loaded when the grid begins play,
+//grid registers with LXR subsystem once loaded and unregisters and frees them when it ends play.
+UCLASS(NotBlueprintable, hidecategories=(Rendering, Replication, Collision, Input, HLOD, Cooking, LOD, Physics))
+class LXRFREE_API ALXRLightGrid : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ALXRLightGrid();
+
+	//Cell edge length. Cells grow if lights of the level would need more than Max Cells cells.
+	UPROPERTY(EditAnywhere, Category="LXR|Light Grid", meta=(ClampMin="100", Units="cm"))
+	float CellSize = 1000.f;
+
+	UPROPERTY(EditAnywhere, Category="LXR|Light Grid", meta=(ClampMin="1"))
+	int32 MaxCells = 1 << 20;
+
+	//Bakes LXR lights of this level that are not movable and not always relevant. Save the level afterwards.
+	UFUNCTION(CallInEditor, Category="LXR|Light Grid")
+	void BakeLightGrid();
+
+	TConstArrayView<TSoftObjectPtr<AActor>> GetBakedLights() const { return Lights; }
+
+	//Appends lights of the cell containing Location. Nothing is appended outside the grid.
+	void GetCellLights(const FVector& Location, TArray<AActor*>& OutLights) const;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	virtual void Serialize(FArchive& Ar) override;
+
+private:
+	void SerializeCellLights(FArchive& Ar);
+
+	//Conservative, cell box is tested as its bounding sphere against spot cones.
+	static bool DoesLightAffectBox(const ULightComponent& LightComponent, float RadiusMultiplier, const FBox& Box);
+
+	UPROPERTY()
+	FVector GridOrigin = FVector::ZeroVector;
+
+	UPROPERTY()
+	float BakedCellSize = 0;
+
+	UPROPERTY()
+	FIntVector GridSize = FIntVector::ZeroValue;
+
+	//Lights of cell X + Y * GridSize.X + Z * GridSize.X * GridSize.Y are
+	//CellLightIndices from CellLightOffsets[Cell] up to CellLightOffsets[Cell + 1], indexing Lights.
+	//Both live in CellLightsPayload and are empty until it is loaded.
+	TArray<int32> CellLightOffsets;
+	TArray<int32> CellLightIndices;
+	FLXRBulkPayload CellLightsPayload;
+
+	//Soft, with World Partition baked lights can live in cells that stream separately from the grid.
+	//Lights that are not loaded are skipped by cell lookups.
+	UPROPERTY()
+	TArray<TSoftObjectPtr<AActor>> Lights;
+
+	UPROPERTY()
+	ULXRSubsystem* LXRSubsystem;
+};
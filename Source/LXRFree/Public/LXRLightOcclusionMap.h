@@ -0,0 +1,101 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LXRLightOcclusionMap.generated.h"
+
+class UWorld;
+class ULightComponent;
+struct FCollisionQueryParams;
+
+UENUM()
+enum class ELXROcclusionMapType : uint8
+{
+	None,
+	Spot,
+	//Six world axis aligned faces, +X -X +Y -Y +Z -Z.
+	Cube
+};
+
+//Depth of first static hit seen from light, baked once by ray casting and kept in CPU memory.
+//Visibility of a point is a projection into the map and a depth compare, no trace is needed.
+//Only static world geometry is baked, movable actors never occlude through the map.
+USTRUCT()
+struct LXRFREE_API FLXRLightOcclusionMap
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	ELXROcclusionMapType Type = ELXROcclusionMapType::None;
+
+	UPROPERTY()
+	int32 Resolution = 0;
+
+	//Light location and rotation when baked. Cube maps only use location.
+	UPROPERTY()
+	FTransform LightTransform;
+
+	//Depths are quantized to 16 bits over 0 - MaxDepth. Texels without a hit store MaxDepth.
+	UPROPERTY()
+	float MaxDepth = 0;
+
+	UPROPERTY()
+	float TanHalfAngle = 0;
+
+	//Row major, Resolution * Resolution texels per face.
+	//Not a property, owner keeps depths of its maps in a bulk payload and map is invalid until that is loaded.
+	TArray<uint16> Depths;
+
+	int32 GetFaceCount() const { return Type == ELXROcclusionMapType::Cube ? 6 : 1; }
+	bool IsValid() const { return Type != ELXROcclusionMapType::None && Depths.Num() == Resolution * Resolution * GetFaceCount(); }
+
+	//True if map was baked with given resolution from light at its current location, rotation, attenuation radius and cone angle.
+	bool IsBakedFrom(const ULightComponent& LightComponent, int32 InResolution) const;
+
+	//Returns false if Point is not covered by the map. Otherwise OutVisible tells if nothing static is between light and Point.
+	//Safe from any thread.
+	bool Sample(const FVector& Point, float DepthBias, bool& OutVisible) const;
+
+	//Map over spot light outer cone or over all six cube faces of a point light, within attenuation radius.
+	//No depths are traced, see BakeTexels. Map type is None for other lights.
+	static FLXRLightOcclusionMap Create(const ULightComponent& LightComponent, int32 Resolution);
+
+	int32 GetTexelCount() const { return Resolution * Resolution * GetFaceCount(); }
+
+	//Traces static geometry for Count texels starting from FirstTexel. Traces run in ParallelFor.
+	//Map is valid as soon as depths are allocated, owner must not sample it before all texels are traced.
+	void BakeTexels(const UWorld& World, int32 FirstTexel, int32 Count, const FCollisionQueryParams& QueryParams);
+
+private:
+	//Direction from light through texel center in world space.
+	FVector GetTexelDirection(int32 Texel) const;
+	//Face and map plane coordinates in -1 - 1 of direction from light. Returns false if map does not cover direction.
+	bool GetFaceCoordinates(const FVector& Direction, int32& OutFace, float& OutU, float& OutV) const;
+
+	static uint16 EncodeDepth(float Depth, float MaxDepth);
+	float DecodeDepth(uint16 Encoded) const;
+};
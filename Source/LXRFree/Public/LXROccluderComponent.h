@@ -0,0 +1,60 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "LXROccluderComponent.generated.h"
+
+class ULXRSubsystem;
+
+//Box that blocks light for detection components using the Occluder BVH visibility backend.
+//Place it to roughly cover walls, floors and large props. Movable occluders refit the BVH when they move.
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class LXRFREE_API ULXROccluderComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	ULXROccluderComponent();
+
+	//Half size of the occluder box, scaled by component scale.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="LXR|Occluder", meta=(ClampMin = "0"))
+	FVector BoxExtent = FVector(50.f);
+
+	//Index of this occluder in LXR subsystem occlusion BVH proxies.
+	int32 OccluderProxyIndex = INDEX_NONE;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	void OnOccluderTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	UPROPERTY()
+	ULXRSubsystem* LXRSubsystem;
+};
@@ -0,0 +1,99 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class AActor;
+
+//Bit per visibility segment. Inline storage covers 128 segments, more than trace targets of one light and detector pair.
+typedef TBitArray<TInlineAllocator<4>> FLXRBlockedBitArray;
+
+//Oriented box standing in for an occluder. Box is [-Extent, Extent] in Transform space, Transform may be scaled.
+struct FLXROccluderProxy
+{
+	FTransform Transform;
+	FVector Extent = FVector::ZeroVector;
+	//World bounds of the oriented box.
+	FBox Bounds = FBox(ForceInit);
+	//Identity only, rays can ignore occluders of given actors.
+	TObjectKey<AActor> Owner;
+
+	void UpdateBounds();
+};
+
+//Bounding volume hierarchy over occluder proxies, used as LXR visibility backend instead of physics scene traces.
+//Coarse on purpose: only proxies block light, no channels, responses or complex geometry.
+//Nodes are 32 bytes and laid out depth first, left child follows its parent.
+//Read only queries are safe from any thread while nothing builds or refits the tree.
+struct LXRFREE_API FLXROcclusionBVH
+{
+	TArray<FLXROccluderProxy> Proxies;
+
+	//Rebuilds tree over all Proxies.
+	void Build();
+
+	//Refreshes node bounds after proxies moved. Tree topology is kept, so it degrades if proxies move far, rebuild then.
+	void Refit();
+
+	bool IsEmpty() const { return Nodes.Num() == 0; }
+
+	bool IsBlocked(const FVector& Start, const FVector& End, TConstArrayView<TObjectKey<AActor>> IgnoredOwners = {}) const;
+
+	//Tests a packet of segments with one traversal, like all trace targets of one light and detector pair.
+	//Bit of each blocked segment is set in OutBlocked.
+	void GetBlockedSegments(TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, FLXRBlockedBitArray& OutBlocked, TConstArrayView<TObjectKey<AActor>> IgnoredOwners = {}) const;
+
+private:
+	struct FNode
+	{
+		FVector3f Min;
+		//Leaf: first index in ProxyIndices. Inner: right child node, left child is next node.
+		int32 FirstOrRight = 0;
+		FVector3f Max;
+		//Proxy count of a leaf, 0 for inner nodes.
+		int32 Count = 0;
+	};
+
+	//Up to 64 segments traversed together, bit per segment.
+	struct FPacket
+	{
+		FVector3f Starts[64];
+		FVector3f Ends[64];
+		FVector3f InverseDirections[64];
+		int32 Num = 0;
+	};
+
+	int32 BuildNode(int32 First, int32 Count);
+	void TraversePacket(const FPacket& Packet, uint64& InOutBlockedMask, TConstArrayView<TObjectKey<AActor>> IgnoredOwners) const;
+
+	static bool SegmentIntersectsBox(const FVector3f& Start, const FVector3f& InverseDirection, const FVector3f& Min, const FVector3f& Max);
+	static bool SegmentIntersectsProxy(const FLXROccluderProxy& Proxy, const FVector& Start, const FVector& End);
+
+	TArray<FNode> Nodes;
+	TArray<int32> ProxyIndices;
+};
@@ -0,0 +1,71 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UPrimitiveComponent;
+
+//Sparse occupancy bit grid of the level, used as LXR visibility backend.
+//Voxels are stored in bricks of 8x8x8 bits, only bricks with a solid voxel exist.
+//Static layer is built from static collision and rebuilt when a level streams in or out, occluder layer is restamped from LXR Occluder bounds when they move.
+//Read only queries are safe from any thread while nothing builds or stamps the grid.
+struct LXRFREE_API FLXROcclusionGrid
+{
+	//Clears both layers.
+	void Reset(float InVoxelSize);
+
+	float GetVoxelSize() const { return VoxelSize; }
+	bool IsEmpty() const { return StaticBricks.Num() == 0 && OccluderBricks.Num() == 0; }
+	int32 GetBrickCount() const { return StaticBricks.Num() + OccluderBricks.Num(); }
+
+	//Marks voxels overlapping component collision. Game thread only.
+	//Returns false without marking anything if component bounds cover more than MaxVoxels voxels.
+	bool AddStaticComponent(const UPrimitiveComponent& Component, int64 MaxVoxels);
+
+	void ClearOccluders();
+	//Marks every voxel touching the box.
+	void AddOccluderBox(const FBox& Box);
+
+	//3D DDA from Start to End. First and last voxel are not tested, rays start and end inside detector and light geometry.
+	bool IsBlocked(const FVector& Start, const FVector& End) const;
+
+private:
+	//Bits[Z] holds the 8x8 voxel layer at Z, bit X + Y * 8.
+	struct FBrick
+	{
+		uint64 Bits[8] = {};
+	};
+
+	FIntVector GetVoxel(const FVector& Location) const;
+	bool IsVoxelSolid(const FIntVector& Voxel) const;
+	static bool IsVoxelSet(const TMap<FIntVector, FBrick>& Bricks, const FIntVector& Voxel);
+	static void SetVoxel(TMap<FIntVector, FBrick>& Bricks, const FIntVector& Voxel);
+
+	float VoxelSize = 50.f;
+	TMap<FIntVector, FBrick> StaticBricks;
+	TMap<FIntVector, FBrick> OccluderBricks;
+};
@@ -0,0 +1,125 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "Engine/EngineTypes.h"
+#include "LXRVisibilityBackend.h"
+#include "LXRSettings.generated.h"
+
+/*Project wide settings for LXR, found under Project Settings -> Plugins -> LXR. */
+UCLASS(Config=Game, DefaultConfig, meta=(DisplayName="LXR"))
+class LXRFREE_API ULXRSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	ULXRSettings();
+
+	//Limit the amount of visibility traces all detection components can issue in a frame.
+	//Detection components are served by priority and work that does not fit in the budget is carried over to later frames.
+	UPROPERTY(Config, EditAnywhere, Category="Budget")
+	bool bEnableTraceBudget = false;
+
+	//Max visibility traces per frame for the whole world. 0 means no trace count limit.
+	UPROPERTY(Config, EditAnywhere, Category="Budget", meta=(EditCondition="bEnableTraceBudget", ClampMin="0"))
+	int32 MaxTracesPerFrame = 256;
+
+	//Max time in milliseconds LXR may spend on relevant light checks per frame. 0 means no time limit.
+	//Only limits detection components served by priority, on demand evaluations and pipelined traces are limited by trace count.
+	UPROPERTY(Config, EditAnywhere, Category="Budget", meta=(EditCondition="bEnableTraceBudget", ClampMin="0", Units="ms"))
+	float MaxTraceTimePerFrameMs = 1.f;
+
+	//Detection components closer than this to the local player get the proximity priority bonus, scaled by distance.
+	UPROPERTY(Config, EditAnywhere, Category="Budget|Priority", meta=(EditCondition="bEnableTraceBudget", ClampMin="1"))
+	float ProximityPriorityDistance = 5000.f;
+
+	//Priority weight of the distance to the local player.
+	UPROPERTY(Config, EditAnywhere, Category="Budget|Priority", meta=(EditCondition="bEnableTraceBudget", ClampMin="0"))
+	float ProximityPriorityWeight = 1.f;
+
+	//Priority weight of the detection component DetectionImportance.
+	UPROPERTY(Config, EditAnywhere, Category="Budget|Priority", meta=(EditCondition="bEnableTraceBudget", ClampMin="0"))
+	float ImportancePriorityWeight = 1.f;
+
+	//Priority weight per second since detection component was last served.
+	//Keeps low priority detection components from starving.
+	UPROPERTY(Config, EditAnywhere, Category="Budget|Priority", meta=(EditCondition="bEnableTraceBudget", ClampMin="0"))
+	float StalenessPriorityWeight = 1.f;
+
+	//Give each detection component a phase offset so that detection components spawned in the same frame
+	//do not run their relevancy checks and LXR calculation on the same frames.
+	UPROPERTY(Config, EditAnywhere, Category="Scheduling")
+	bool bStaggerDetectorUpdates = true;
+
+	//Occlusion map texels traced per frame when LXR Sources bake missing or outdated maps at play, each texel is one trace.
+	//Lights are traced normally until their map is done.
+	UPROPERTY(Config, EditAnywhere, Category="Occlusion Map", meta=(ClampMin="1"))
+	int32 OcclusionMapTexelsPerFrame = 1024;
+
+	//Visibility backend of detection components using Project Default.
+	UPROPERTY(Config, EditAnywhere, Category="Visibility")
+	ELXRVisibilityBackend DefaultVisibilityBackend = ELXRVisibilityBackend::Physics;
+
+	//Voxel size of the occlusion grid used by Voxel Occlusion Grid visibility backend.
+	//Grid is built from static collision when the first detection component using it begins play and rebuilt when a level streams in or out.
+	UPROPERTY(Config, EditAnywhere, Category="Occlusion Grid", meta=(ClampMin="1", Units="cm"))
+	float OcclusionVoxelSize = 50.f;
+
+	//Static collision blocking this channel is voxelized.
+	UPROPERTY(Config, EditAnywhere, Category="Occlusion Grid")
+	TEnumAsByte<ECollisionChannel> OcclusionGridChannel = ECC_Visibility;
+
+	//Components whose bounds cover more voxels than this are left out of the grid, like landscapes and sky spheres.
+	UPROPERTY(Config, EditAnywhere, Category="Occlusion Grid", meta=(ClampMin="1"))
+	int64 MaxVoxelsPerComponent = 1000000;
+
+	//Answer directional light visibility from a sun aligned height field of WorldStatic geometry instead of long traces toward the sun.
+	//Field follows the first directional light of a LXR Source and is rebuilt a few rows per frame on worker threads when the sun rotates or a level streams in or out.
+	//Field is traced against WorldStatic objects only, detection component Trace Channel and ignored actors do not apply to it.
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field")
+	bool bUseSunHeightField = false;
+
+	//Cell size of the field. Cells grow if the level needs more than Max Resolution cells per side.
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field", meta=(EditCondition="bUseSunHeightField", ClampMin="1", Units="cm"))
+	float SunHeightFieldCellSize = 100.f;
+
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field", meta=(EditCondition="bUseSunHeightField", ClampMin="1", ClampMax="4096"))
+	int32 SunHeightFieldMaxResolution = 1024;
+
+	//Sun rotation that starts a rebuild. Directional checks fall back to traces while the field is further off than this.
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field", meta=(EditCondition="bUseSunHeightField", ClampMin="0.01", Units="Degrees"))
+	float SunHeightFieldRebuildAngle = 2.f;
+
+	//Rows traced per frame while rebuilding, each row is one trace per cell.
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field", meta=(EditCondition="bUseSunHeightField", ClampMin="1"))
+	int32 SunHeightFieldRowsPerFrame = 16;
+
+	//Point is lit if it is at most this much below the highest static hit of its column. Hides geometry the point stands next to.
+	UPROPERTY(Config, EditAnywhere, Category="Sun Height Field", meta=(EditCondition="bUseSunHeightField", ClampMin="0", Units="cm"))
+	float SunHeightFieldBias = 20.f;
+};
@@ -26,9 +26,12 @@ SOFTWARE.
 
 #include "CoreMinimal.h"
 #include "LXRSubsystem.h"
+#include "LXRLightOcclusionMap.h"
+#include "LXRBulkPayload.h"
 #include "Components/ActorComponent.h"
 #include "LXRSourceComponent.generated.h"
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLXRDetectedActorsChanged, const TArray<AActor*>&, Actors);
 
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
 class LXRFREE_API ULXRSourceComponent : public UActorComponent
@@ -39,6 +42,8 @@ public:
 	// Sets default values for this component's properties
 	ULXRSourceComponent();
 
+	static void AddReferencedObjects(UObject* InThis, FReferenceCollector& Collector);
+
 	//Should LightDetection component show debug about this light source actor.
 	UPROPERTY(BlueprintReadWrite,EditAnywhere, Category="LXR|Source|Debug", meta=(AdvancedDisplay))
 	bool bDrawDebug = false;
@@ -91,14 +96,55 @@ public:
 	UPROPERTY(EditAnywhere, Category="LXR|Source", meta=(UseComponentPicker, AllowedClasses="LightComponent", EditCondition = "GetMyLightComponentsMethodToUse == EMethodToUse::Class"))
 	TArray<FComponentReference> ExcludedLights;
 	
-	//List of Detected actors.
-	UPROPERTY(BlueprintReadWrite, Category="LXR|Source")
-	TArray<AActor*> DetectedActors;
-
 	//List of actors to ignore when checking visibility.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="LXR|Source")
 	TArray<AActor*> IgnoreVisibilityActors;
 
+	//Store fixture meshes around owner when level is saved or cooked.
+	//Overlap query is skipped at play if owner has not moved since and all cached actors are loaded.
+	UPROPERTY(EditAnywhere, Category="LXR|Source")
+	bool bCacheOverlappingActors = false;
+
+	//Use occlusion maps of non movable spot and point lights. Visibility to a baked light is a depth compare instead of a trace.
+	//Maps baked in editor are saved as bulk data and loaded asynchronously when play begins. Missing or outdated maps are baked after that
+	//over several frames, see Occlusion Map Texels Per Frame in project settings, and the light is traced normally until its map is done.
+	//Only WorldStatic geometry is baked, movable actors block baked lights only through bTraceOccludersOverOcclusionMaps.
+	UPROPERTY(EditAnywhere, Category="LXR|Source|Occlusion Map")
+	bool bBakeOcclusionMaps = false;
+
+	//Occlusion map width and height in texels. Point lights bake six faces of this size.
+	UPROPERTY(EditAnywhere, Category="LXR|Source|Occlusion Map", meta=(EditCondition="bBakeOcclusionMaps", ClampMin="4", ClampMax="256"))
+	int32 OcclusionMapResolution = 32;
+
+	//Point is visible if it is at most this much further than baked depth. Hides quantization and texel size errors.
+	UPROPERTY(EditAnywhere, Category="LXR|Source|Occlusion Map", meta=(EditCondition="bBakeOcclusionMaps", ClampMin="0"))
+	float OcclusionMapDepthBias = 20.f;
+
+	//Trace normally when occlusion map says visible but a LXR Occluder overlaps the segment.
+	UPROPERTY(EditAnywhere, Category="LXR|Source|Occlusion Map", meta=(EditCondition="bBakeOcclusionMaps"))
+	bool bTraceOccludersOverOcclusionMaps = true;
+
+	//Actors that started being detected since last frame. Broadcast once per frame.
+	UPROPERTY(BlueprintAssignable, Category="LXR|Source")
+	FOnLXRDetectedActorsChanged OnDetected;
+
+	//Actors that stopped being detected since last frame. Broadcast once per frame.
+	UPROPERTY(BlueprintAssignable, Category="LXR|Source")
+	FOnLXRDetectedActorsChanged OnUndetected;
+
+	//List of Detected actors.
+	UFUNCTION(BlueprintPure, Category="LXR|Source")
+	TArray<AActor*> GetDetectedActors() const;
+
+	UFUNCTION(BlueprintPure, Category="LXR|Source")
+	bool IsActorDetected(AActor* Actor) const;
+
+	UFUNCTION(BlueprintCallable, Category="LXR|Source")
+	void AddDetectedActor(AActor* DetectedActor);
+
+	UFUNCTION(BlueprintCallable, Category="LXR|Source")
+	void RemoveDetectedActor(AActor* DetectedActor);
+
 	//IF owner does not implement ILightSource::IsEnabled, then use this function to determine if light source is enabled.
 	UFUNCTION(BlueprintPure, Category="LXR|Source")
 	bool IsEnabled() const;
@@ -120,6 +166,22 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent, Category="LXR|Source")
 	TArray<AActor*> GetIgnoreVisibilityActors();
 
+	//Notify detection components that this light source has changed, wakes up dormant detection components.
+	//Transform, color, intensity and visibility changes are picked up automatically on tick, call this to react immediately.
+	UFUNCTION(BlueprintCallable, Category="LXR|Source")
+	void MarkLightChanged();
+
+	//Increases every time light source transform, color, intensity or visibility changes.
+	uint32 GetChangeGeneration() const;
+
+	//Enables or disables component, dormant detection components wake up right away.
+	UFUNCTION(BlueprintCallable, Category="LXR|Source")
+	void SetDisabled(bool bNewDisable);
+
+	//Dormant detection components this light is relevant to, light state is polled at fastest tick interval while any listen.
+	void AddDormantListener();
+	void RemoveDormantListener();
+
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
@@ -128,22 +190,117 @@ protected:
 
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+public:
+	virtual void Serialize(FArchive& Ar) override;
+
+protected:
+
 	FLinearColor GetLightComponentColor(const ULightComponent& LightComponent);
 
 public:
+	//Queues registration, subsystem registers lights of a level in one batch.
 	void RegisterLight();
 	void DeRegisterLight() const;
-	TArray<ULightComponent*> GetMyLightComponents() const;
-	TArray<AActor*>& GetMyOverlappingActors();
+	//Queues unregistration, used when owner level is streamed out.
+	void QueueDeRegisterLight() const;
+	const TArray<ULightComponent*>& GetMyLightComponents() const;
+	TConstArrayView<ULightComponent*> GetLightComponentsView() const;
+	const TArray<TWeakObjectPtr<AActor>>& GetMyOverlappingActors() const;
+
+	//Actors to ignore when checking visibility. Calls GetIgnoreVisibilityActors only if it is overridden in Blueprint, at most once per frame.
+	TConstArrayView<AActor*> GetVisibilityIgnoredActors();
+
+	//WorldStatic actors within 30 units of Location, the fixture meshes visibility traces ignore. Thread safe scene query.
+	static void GatherOverlappingActors(const UWorld& World, const FVector& Location, TArray<AActor*>& OutOverlappingActors);
+
+	//Result of a batched overlap query run by subsystem.
+	void SetOverlappingActors(TConstArrayView<AActor*> OverlappingActors, const FVector& QueryLocation);
+
+#if WITH_EDITOR
+	virtual void PreSave(FObjectPreSaveContext SaveContext) override;
+#endif
+
+	//Light components of owner not in ExcludedLights. Works before BeginPlay, unlike GetMyLightComponents.
+	void GetLightComponents(TArray<ULightComponent*>& OutLightComponents) const;
+
+	//Broadcasts OnDetected and OnUndetected with changes since last flush. Called by subsystem once per frame.
+	void FlushDetectedActorChanges();
+
+	//Rebakes occlusion maps of all non movable spot and point lights. Call after static geometry around the light changes.
+	UFUNCTION(CallInEditor, Category="LXR|Source|Occlusion Map")
+	void BakeOcclusionMaps();
+
+	//Baked occlusion map of light component, NULL if component has none or its bake is not done.
+	const FLXRLightOcclusionMap* GetOcclusionMap(int32 LightComponentIndex) const;
+
+	//Traces at most InOutTexelBudget texels of pending maps and subtracts traced texels from it. Called by subsystem tick.
+	//Returns true when no maps are left to bake.
+	bool BakePendingOcclusionMaps(int32& InOutTexelBudget);
 
 
 protected:
 	UPROPERTY(BlueprintReadOnly, Category="LXR|Source")
 	TArray<ULightComponent*> MyLightComponents;
 
-	UPROPERTY()
-	TArray<AActor*> MyOverlappingActors;
+	TArray<TWeakObjectPtr<AActor>> MyOverlappingActors;
+	TSet<TWeakObjectPtr<AActor>> DetectedActors;
+	//Changes since last flush. Actor detected and undetected within same frame cancels out.
+	TSet<TWeakObjectPtr<AActor>> PendingDetectedActors;
+	TSet<TWeakObjectPtr<AActor>> PendingUndetectedActors;
+	bool bDetectedActorChangesQueued = false;
+
+	void QueueDetectedActorChanges();
 
 	void FindMyLightComponents();
+	//Fixture meshes around owner, ignored by visibility traces. Blocking, used by editor bakes.
+	void FindMyOverlappingActors();
+	//Uses overlaps cached at save if still valid, otherwise subsystem queries them with other sources in one batch.
+	void QueueOverlappingActorsQuery();
+	//Bakes maps that are missing or were baked from another location or resolution.
+	//Bake is spread over frames by the subsystem in game worlds, editor bakes finish before returning.
+	void UpdateOcclusionMaps();
+	//Loads depths from OcclusionMapsPayload, then updates maps.
+	void LoadOcclusionMaps();
+	void SerializeOcclusionMapDepths(FArchive& Ar);
+
+	uint32 CalculateLightStateHash() const;
+
+	uint32 ChangeGeneration = 0;
+	uint32 LastLightStateHash = 0;
+	int32 DormantListeners = 0;
+
+	bool bIgnoreVisibilityActorsInScript = false;
+
+	//Kept between calls, referenced in AddReferencedObjects.
+	TArray<AActor*> ScriptIgnoreVisibilityActors;
+	uint64 ScriptIgnoreVisibilityActorsFrame = MAX_uint64;
+
+	//Indexed by light component index, maps of components that are not baked are left invalid.
+	UPROPERTY()
+	TArray<FLXRLightOcclusionMap> OcclusionMaps;
+	FLXRBulkPayload OcclusionMapsPayload;
+	//Maps being baked, moved to OcclusionMaps once all texels are traced.
+	struct FPendingOcclusionMap
+	{
+		FLXRLightOcclusionMap Map;
+		int32 LightComponentIndex = INDEX_NONE;
+		int32 NextTexel = 0;
+	};
+	TArray<FPendingOcclusionMap> PendingOcclusionMaps;
+	//Maps are loaded once overlapping actors are known, bakes must ignore fixture meshes.
+	bool bOcclusionMapsRequested = false;
+
+	//Owner location of last overlap query, query is repeated when owner moves.
+	FVector OverlapQueryLocation = FVector::ZeroVector;
+	bool bOverlapQueryQueued = false;
+
+	UPROPERTY()
+	TArray<TSoftObjectPtr<AActor>> CachedOverlappingActors;
+
+	UPROPERTY()
+	FVector CachedOverlapLocation = FVector::ZeroVector;
+
+	UPROPERTY()
+	bool bHasCachedOverlappingActors = false;
 
 };
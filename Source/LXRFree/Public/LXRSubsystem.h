@@ -26,18 +26,38 @@ SOFTWARE.
 
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
+#include "Tasks/Task.h"
+#include "CollisionQueryParams.h"
 #include  "LXRFree.h"
+#include "LXRFrameSnapshot.h"
+#include "LXROcclusionBVH.h"
+#include "LXROcclusionGrid.h"
+#include "LXRSunHeightField.h"
+#include "LXRVisibilityBackend.h"
 #include "LXRSubsystem.generated.h"
 
+class ULXRDetectionComponent;
+class ULXRSourceComponent;
+class ULXROccluderComponent;
+class ALXRLightGrid;
+class ULightComponent;
+
 DECLARE_EVENT_OneParam(ULightDetectionSubsystem, FOnLightAdded, AActor*);
 
 DECLARE_EVENT_OneParam(ULightDetectionSubsystem, FOnLightRemoved, AActor*);
 
+DECLARE_EVENT_OneParam(ULightDetectionSubsystem, FOnLightsChanged, TConstArrayView<TWeakObjectPtr<AActor>>);
+
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Traces in second (Sync)"), STAT_TRACESSYNC, STATGROUP_LXR);
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Traces in second (Multithread)"), STAT_TRACESMULTITHREAD, STATGROUP_LXR);
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Tasks in second (Multithread)"), STAT_THREADS, STATGROUP_LXR);
 
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("LightSense TraceTarget Traces"), STAT_TRACELIGHTSENSETARGETS, STATGROUP_LXR);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Visibility Cache Hits in second"), STAT_VISIBILITYCACHEHITS, STATGROUP_LXR);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Occluder BVH Rays in second"), STAT_OCCLUDERBVHRAYS, STATGROUP_LXR);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Occlusion Grid Rays in second"), STAT_OCCLUSIONGRIDRAYS, STATGROUP_LXR);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Occlusion Map Samples in second"), STAT_OCCLUSIONMAPSAMPLES, STATGROUP_LXR);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Sun Height Field Samples in second"), STAT_SUNHEIGHTFIELDSAMPLES, STATGROUP_LXR);
 
 DECLARE_DWORD_COUNTER_STAT(TEXT("Relevant Lights"), STAT_RELEVANTLIGHTS, STATGROUP_LXR);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Passed Relevant Lights"), STAT_PASSEDRELEVANTLIGHTS, STATGROUP_LXR);
@@ -46,11 +66,22 @@ DECLARE_DWORD_COUNTER_STAT(TEXT("Smart Near"), STAT_SMARTNEAR, STATGROUP_LXR);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Smart Mid"), STAT_SMARTMID, STATGROUP_LXR);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Smart Far"), STAT_SMARTFAR, STATGROUP_LXR);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Light Sense"), STAT_LIGHTSENSE, STATGROUP_LXR);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Budget Traces"), STAT_BUDGETTRACES, STATGROUP_LXR);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Budget Deferred Detectors"), STAT_BUDGETDEFERRED, STATGROUP_LXR);
 
 DECLARE_CYCLE_STAT(TEXT("Relevant Check"), STAT_RelevantCheck, STATGROUP_LXR);
 DECLARE_CYCLE_STAT(TEXT("Relevancy Check"), STAT_RelevancyCheck, STATGROUP_LXR);
 DECLARE_CYCLE_STAT(TEXT("Get Combined Datas"), STAT_GetCombinedDatas, STATGROUP_LXR);
 DECLARE_CYCLE_STAT(TEXT("Light Sense Check"), STAT_LightSenseCheck, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Subsystem Tick"), STAT_SubsystemTick, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Publish Frame Snapshot"), STAT_PublishFrameSnapshot, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Parallel Visibility Traces"), STAT_ParallelVisibilityTraces, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Update Occlusion BVH"), STAT_UpdateOcclusionBVH, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Build Occlusion Grid"), STAT_BuildOcclusionGrid, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Bake Occlusion Maps"), STAT_BakeOcclusionMaps, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Build Sun Height Field"), STAT_BuildSunHeightField, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Register Lights"), STAT_RegisterLights, STATGROUP_LXR);
+DECLARE_CYCLE_STAT(TEXT("Overlapping Actors Queries"), STAT_OverlappingActorsQueries, STATGROUP_LXR);
 
 
 USTRUCT(BlueprintType)
@@ -77,16 +108,37 @@ struct LXRFREE_API FLightSourcePassedData
 	TArray<int> PassedComponents;
 };
 
+//Visibility ray queued for the shared ParallelFor batch.
+struct FLXRVisibilityRay
+{
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	//Index to subsystem query params, physics backend only.
+	int32 QueryParamsIndex = 0;
+	ECollisionChannel TraceChannel = ECC_Visibility;
+	ELXRVisibilityBackend Backend = ELXRVisibilityBackend::Physics;
+	//Occluder BVH proxies of detector and light actors do not block the ray.
+	TObjectKey<AActor> IgnoredOwners[2];
+};
+
 /**
  * 
  */
 UCLASS()
-class LXRFREE_API ULXRSubsystem : public UWorldSubsystem
+class LXRFREE_API ULXRSubsystem : public UTickableWorldSubsystem
 {
 	GENERATED_BODY()
 public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
 	FOnLightAdded OnLightAdded;
 	FOnLightRemoved OnLightRemoved;
+	//Broadcast once per registration batch, after per light events.
+	FOnLightsChanged OnLightsAdded;
+	FOnLightsChanged OnLightsRemoved;
 
 	//Registers new light source for LXR
 	UFUNCTION(BlueprintCallable,Category="LXR")
@@ -96,14 +148,191 @@ public:
 	UFUNCTION(BlueprintCallable,Category="LXR")
 	void UnregisterLight(AActor* LightSource);
 
+	//Registers light sources at once. Already registered lights are skipped, OnLightsAdded is broadcast once for the batch.
+	void RegisterLights(TConstArrayView<AActor*> NewLightSources);
+	//Removes light sources at once with a single pass over the light list, OnLightsRemoved is broadcast once for the batch.
+	void UnregisterLights(TConstArrayView<AActor*> RemovedLightSources);
+
+	//Light sources begin and end play in bursts when levels stream. Queued lights are registered or unregistered in one batch
+	//when the level is added to or removed from the world, or at next subsystem tick at the latest.
+	void QueueLightRegistration(AActor* LightSource);
+	void QueueLightUnregistration(AActor* LightSource);
+
+	//Fixture mesh overlap queries of sources are run together in one ParallelFor before queued lights are registered.
+	void QueueOverlappingActorsQuery(ULXRSourceComponent* LightSourceComponent);
+
+	//Pending occlusion maps of sources are baked OcclusionMapTexelsPerFrame texels per frame, in queue order.
+	void QueueOcclusionMapBake(ULXRSourceComponent* LightSourceComponent);
+
 	const TArray<TWeakObjectPtr<AActor>>& GetAllLights() const;
+	//Shared light list for all detection components, iterate it instead of copying it.
+	TConstArrayView<TWeakObjectPtr<AActor>> GetAllLightsView() const;
+	//Changes every time a light is registered or unregistered.
+	uint32 GetLightsVersion() const { return LightsVersion; }
+
+	//Light source FlushDetectedActorChanges is called on next subsystem tick.
+	void QueueDetectedActorChanges(ULXRSourceComponent* LightSourceComponent);
+
+	void RegisterDetector(ULXRDetectionComponent* DetectionComponent);
+	void UnregisterDetector(ULXRDetectionComponent* DetectionComponent);
+
+	//Wakes up dormant detection components whose detection area intersects the bounds.
+	//Call when a dynamic occluder, like a door, moves.
+	UFUNCTION(BlueprintCallable, Category="LXR")
+	void NotifyOccluderChanged(const FBox& OccluderBounds);
+
+	//Occluder proxies for the Occluder BVH visibility backend. BVH is rebuilt or refit at start of next subsystem tick.
+	void RegisterOccluder(ULXROccluderComponent* Occluder);
+	void UnregisterOccluder(ULXROccluderComponent* Occluder);
+	void MarkOccluderMoved(ULXROccluderComponent* Occluder);
+	const FLXROcclusionBVH& GetOcclusionBVH() const { return OcclusionBVH; }
+
+	//Voxel occlusion grid is built on next subsystem tick. Occluder layer follows LXR Occluders from then on.
+	void RequestOcclusionGrid();
+	const FLXROcclusionGrid& GetOcclusionGrid() const { return OcclusionGrid; }
+
+	//Baked light grids. Lights baked into a registered grid are left out of relevancy scanning and found by cell lookup instead.
+	void RegisterLightGrid(ALXRLightGrid* LightGrid);
+	void UnregisterLightGrid(ALXRLightGrid* LightGrid);
+	bool HasLightGrids() const { return LightGrids.Num() > 0; }
+	bool IsLightInLightGrid(const AActor* LightSource) const { return LightGridLights.Contains(LightSource); }
+	//Appends baked lights of every grid cell containing Location.
+	void GetLightGridLights(const FVector& Location, TArray<AActor*>& OutLights) const;
+
+	//Sun visibility of Point from the sun height field. Returns false if field is disabled, not built for current sun rotation,
+	//LightComponent is not the sun the field follows or Point is outside the field. Safe from any thread during game thread work.
+	bool SampleSunVisibility(const ULightComponent& LightComponent, const FVector& Point, bool& OutVisible) const;
+
+	//Backend implementation for a resolved backend type, Project Default is resolved to the project setting.
+	const ILXRVisibilityBackend& GetVisibilityBackend(ELXRVisibilityBackend Backend) const;
+	ELXRVisibilityBackend ResolveVisibilityBackend(ELXRVisibilityBackend Backend) const;
+	//Backend used by detection components with Custom visibility backend. Must stay thread safe, see ILXRVisibilityBackend.
+	void SetCustomVisibilityBackend(TSharedPtr<ILXRVisibilityBackend> Backend);
+
+	//Traces same rays, from every detection component trace target to every light, with every backend and logs time and agreement with Physics.
+	void BenchmarkVisibilityBackends(int32 MaxRays);
+
+	//Queues detection component to be served when trace budget is enabled.
+	void RequestDetectorUpdate(ULXRDetectionComponent* DetectionComponent);
+
+	//Is there trace budget left for this frame. Always true when trace budget is disabled.
+	//Every path issuing visibility traces checks this, work that does not fit is deferred to a later frame.
+	//Trace count is shared by the whole frame, time limit only applies while detection components are served by priority.
+	bool HasTraceBudget() const;
+
+	//Adds traces to this frame trace count.
+	void ConsumeTraceBudget(int32 TraceCount);
+
+	bool IsTraceBudgetEnabled() const;
+
+	//Last published snapshot. Safe to read from any thread until the frame after next snapshot is published,
+	//or for as long as a task registered with AddFrameSnapshotReader runs.
+	//Only built while there are snapshot users.
+	const FLXRFrameSnapshot& GetFrameSnapshot() const;
+
+	//Task reading the published snapshot. Snapshot buffer is not rebuilt before the task completes.
+	void AddFrameSnapshotReader(const UE::Tasks::FTask& Task);
+
+	//Work that reads frame snapshots registers here, snapshots are not built when nobody uses them.
+	void AddFrameSnapshotUser();
+	void RemoveFrameSnapshotUser();
+
+	//ParallelFor trace type. Rays of all detection components are traced together at end of subsystem tick,
+	//then every requesting detection component gets the visibility of all rays, indexed by queue order.
+	int32 AddVisibilityQueryParams(const FCollisionQueryParams& QueryParams);
+	void QueueVisibilityRay(const FLXRVisibilityRay& Ray);
+	int32 GetQueuedVisibilityRayCount() const { return VisibilityRays.Num(); }
+	void RequestParallelVisibilityResults(ULXRDetectionComponent* DetectionComponent);
+
+	//Returns next phase offset in range 0-1 for a detection component. Offsets are evenly distributed regardless of how many are assigned.
+	float AssignDetectorPhase();
 
 	bool bSoloFound;
 
 private:
-	UPROPERTY()
+	void FlushLightRegistrations();
+	void RunOverlappingActorsQueries();
+	void RemoveRegisteredLights(TConstArrayView<TWeakObjectPtr<AActor>> LightSourcesToRemove);
+	void OnLevelAddedToWorld(ULevel* Level, UWorld* World);
+	void OnLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+	void ServeDetectorsByPriority();
+	void FlushDetectedActorChanges();
+	void PublishFrameSnapshot();
+	void TraceQueuedVisibilityRays();
+	void UpdateOcclusionBVH();
+	void BuildOcclusionGrid();
+	void UpdateOcclusionGridOccluders();
+	void UpdateSunHeightField();
+	void UpdateOcclusionMapBakes();
+	void UpdateLightGridLights();
+	//Thread safe when the ray is from the shared ParallelFor batch.
+	bool IsVisibilityBlocked(const FLXRVisibilityRay& Ray) const;
+	float GetDetectorPriority(const ULXRDetectionComponent& DetectionComponent, const FVector& ViewLocation, bool bHasViewLocation, double Now) const;
+	bool GetViewLocation(FVector& OutViewLocation) const;
+
 	TArray<TWeakObjectPtr<AActor>> LightSources;
+	//Same lights as LightSources, for constant time duplicate checks.
+	TSet<TWeakObjectPtr<AActor>> LightSourceSet;
+	uint32 LightsVersion = 0;
+	TArray<TWeakObjectPtr<AActor>> PendingLightRegistrations;
+	TArray<TWeakObjectPtr<AActor>> PendingLightUnregistrations;
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> PendingOverlapQueries;
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> OcclusionMapBakes;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	//Double buffered, next snapshot is built into the buffer not being read.
+	FLXRFrameSnapshot FrameSnapshots[2];
+	int32 ReadFrameSnapshotIndex = 0;
+	TArray<UE::Tasks::FTask> FrameSnapshotReaders[2];
+	int32 FrameSnapshotUsers = 0;
+
+	TArray<TWeakObjectPtr<ULXRDetectionComponent>> Detectors;
+	TArray<TWeakObjectPtr<ULXRDetectionComponent>> PendingDetectors;
+	TArray<TWeakObjectPtr<ULXRSourceComponent>> SourcesWithDetectedActorChanges;
+
+	FLXROcclusionBVH OcclusionBVH;
+	TArray<TWeakObjectPtr<ULXROccluderComponent>> Occluders;
+	TArray<TWeakObjectPtr<ULXROccluderComponent>> MovedOccluders;
+	bool bOccludersChanged = false;
+
+	FLXROcclusionGrid OcclusionGrid;
+
+	FLXRPhysicsVisibilityBackend PhysicsVisibilityBackend;
+	FLXROccluderBVHVisibilityBackend OccluderBVHVisibilityBackend{OcclusionBVH};
+	FLXROcclusionGridVisibilityBackend OcclusionGridVisibilityBackend{OcclusionGrid};
+	FLXRAlwaysVisibleBackend AlwaysVisibleBackend;
+	TSharedPtr<ILXRVisibilityBackend> CustomVisibilityBackend;
+	bool bOcclusionGridRequested = false;
+	bool bOcclusionGridBuilt = false;
+	bool bOcclusionGridOccludersDirty = false;
+
+	TArray<TWeakObjectPtr<ALXRLightGrid>> LightGrids;
+	TSet<TObjectKey<AActor>> LightGridLights;
+
+	//Sampled field and field being built, swapped when all rows of the building field are traced.
+	FLXRSunHeightField SunHeightFields[2];
+	int32 ReadSunHeightFieldIndex = 0;
+	int32 NextSunHeightFieldRow = INDEX_NONE;
+	TWeakObjectPtr<ULightComponent> SunLight;
+	uint32 SunLightsVersion = MAX_uint32;
+	FVector SunDirection = FVector::ZeroVector;
+	//Set when a level streams in or out, field is rebuilt from the current level bounds and geometry.
+	bool bSunHeightFieldDirty = false;
+
+	//Shared ParallelFor batch, kept between frames to reuse allocations.
+	TArray<FLXRVisibilityRay> VisibilityRays;
+	TArray<FCollisionQueryParams> VisibilityQueryParams;
+	TArray<uint8> VisibilityRayResults;
+	TArray<TWeakObjectPtr<ULXRDetectionComponent>> ParallelVisibilityDetectors;
+
+	int32 FrameTraceCount = 0;
+	//Frame FrameTraceCount was counted in, count starts over on the first budget call of a new frame.
+	uint64 FrameTraceCountFrame = 0;
+	double FrameBudgetStartTime = 0;
+	bool bServingDetectors = false;
 
+	int32 NextDetectorPhaseIndex = 0;
 
 };
 
@@ -0,0 +1,68 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+struct FCollisionQueryParams;
+
+//Sun aligned shadow height field of static world geometry.
+//Columns run along sun direction, each cell stores the height toward the sun of the highest static hit in its column.
+//Point is lit by the sun if nothing in its column is higher than the point itself, a map sample and a compare.
+//Rows are traced independently, so a field can be built a few rows at a time on worker threads.
+struct LXRFREE_API FLXRSunHeightField
+{
+	//Clears field and lays out cells over Bounds as seen from the sun. Cell size grows if Bounds needs more than MaxResolution cells per side.
+	void Reset(const FVector& InSunDirection, const FBox& Bounds, float InCellSize, int32 MaxResolution);
+
+	//Traces all cells of a row. Different rows can be built in parallel.
+	void BuildRow(const UWorld& World, int32 Row, const FCollisionQueryParams& QueryParams);
+
+	int32 GetRowCount() const { return SizeV; }
+	bool IsEmpty() const { return Heights.Num() == 0; }
+	//Unit vector toward the sun the field was laid out for.
+	const FVector& GetSunDirection() const { return SunDirection; }
+
+	//Returns false if Point is outside field. Otherwise OutVisible tells if no static geometry is between Point and the sun.
+	//Safe from any thread while the field is not built.
+	bool Sample(const FVector& Point, float Bias, bool& OutVisible) const;
+
+private:
+	FVector SunDirection = FVector::UpVector;
+	//Field plane axes, perpendicular to SunDirection.
+	FVector AxisU = FVector::ForwardVector;
+	FVector AxisV = FVector::RightVector;
+	FVector2D Origin = FVector2D::ZeroVector;
+	float CellSize = 100.f;
+	int32 SizeU = 0;
+	int32 SizeV = 0;
+	//Bounds along SunDirection, rays run from MaxHeight down to MinHeight.
+	float MinHeight = 0;
+	float MaxHeight = 0;
+	//Row major, -MAX_flt where column is empty.
+	TArray<float> Heights;
+};
@@ -0,0 +1,113 @@
+/*
+ *MIT License*
+
+Copyright (c) 2023 Clusterfact Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "UObject/ObjectKey.h"
+#include "LXROcclusionBVH.h"
+#include "LXRVisibilityBackend.generated.h"
+
+struct FLXROcclusionGrid;
+
+//What answers relevant light visibility checks.
+//Pipelined relevant trace type always uses async physics traces for Physics, other backends are answered right away.
+UENUM(BlueprintType)
+enum class ELXRVisibilityBackend : uint8
+{
+	// Use DefaultVisibilityBackend from LXR project settings.
+	ProjectDefault UMETA(DisplayName = "Project Default"),
+	// Physics scene line traces on TraceChannel.
+	Physics UMETA(DisplayName = "Physics"),
+	// Box proxies of LXR Occluder components in a BVH owned by LXR subsystem. Coarse and fast, only LXR Occluders block light.
+	OccluderBVH UMETA(DisplayName = "Occluder BVH"),
+	// DDA ray marching through a voxel grid of static collision and LXR Occluder bounds. Voxel size is set in LXR project settings.
+	OcclusionGrid UMETA(DisplayName = "Voxel Occlusion Grid"),
+	// Nothing blocks light. For testing and for measuring visibility cost.
+	AlwaysVisible UMETA(DisplayName = "Always Visible"),
+	// Backend given to ULXRSubsystem::SetCustomVisibilityBackend, Physics until one is set.
+	Custom UMETA(DisplayName = "Custom"),
+};
+
+//Settings shared by all segments of one visibility request.
+struct FLXRVisibilityQuery
+{
+	ECollisionChannel TraceChannel = ECC_Visibility;
+	//Physics backend only, default query params when NULL.
+	const FCollisionQueryParams* QueryParams = NULL;
+	//Occluders of these actors do not block, usually detector and light actors.
+	TConstArrayView<TObjectKey<AActor>> IgnoredOwners;
+};
+
+//Answers LXR visibility segments, from trace target to light. Segment is visible when nothing blocks it.
+//Implementations must be safe to call from worker threads while the world is not being modified,
+//ParallelFor relevant trace type calls them from there.
+class LXRFREE_API ILXRVisibilityBackend
+{
+public:
+	virtual ~ILXRVisibilityBackend() = default;
+
+	virtual bool IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const = 0;
+
+	//Sets bit of every blocked segment in OutBlocked. Tests segments one by one unless backend can do better.
+	virtual void GetBlockedSegments(const UWorld& World, TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, const FLXRVisibilityQuery& Query, FLXRBlockedBitArray& OutBlocked) const;
+};
+
+class LXRFREE_API FLXRPhysicsVisibilityBackend : public ILXRVisibilityBackend
+{
+public:
+	virtual bool IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const override;
+};
+
+class LXRFREE_API FLXROccluderBVHVisibilityBackend : public ILXRVisibilityBackend
+{
+public:
+	explicit FLXROccluderBVHVisibilityBackend(const FLXROcclusionBVH& InBVH) : BVH(InBVH) {}
+
+	virtual bool IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const override;
+	//Whole packet goes down the tree in one traversal.
+	virtual void GetBlockedSegments(const UWorld& World, TConstArrayView<FVector> Starts, TConstArrayView<FVector> Ends, const FLXRVisibilityQuery& Query, FLXRBlockedBitArray& OutBlocked) const override;
+
+private:
+	const FLXROcclusionBVH& BVH;
+};
+
+class LXRFREE_API FLXROcclusionGridVisibilityBackend : public ILXRVisibilityBackend
+{
+public:
+	explicit FLXROcclusionGridVisibilityBackend(const FLXROcclusionGrid& InGrid) : Grid(InGrid) {}
+
+	virtual bool IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const override;
+
+private:
+	const FLXROcclusionGrid& Grid;
+};
+
+class LXRFREE_API FLXRAlwaysVisibleBackend : public ILXRVisibilityBackend
+{
+public:
+	virtual bool IsBlocked(const UWorld& World, const FVector& Start, const FVector& End, const FLXRVisibilityQuery& Query) const override { return false; }
+};